@@ -0,0 +1,58 @@
+#include "export_rows.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace export_rows {
+
+bool splitSpoolName(const char* name, char* rfid, char* ts14, char* scanner){
+  const char* base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  if (strncmp(base, "LOG.", 4)) return false;
+  const char* r  = base + 4;
+  const char* d1 = strchr(r, '.');
+  if (!d1 || d1 == r || (size_t)(d1 - r) > kRfidMax) return false;
+  const char* t  = d1 + 1;
+  const char* d2 = strchr(t, '.');
+  if (!d2 || d2 - t != 14) return false;
+  const char* sc = d2 + 1;
+  const char* d3 = strchr(sc, '.');           // optional collision suffix ".N"
+  size_t slen = d3 ? (size_t)(d3 - sc) : strlen(sc);
+  if (!slen || slen > kScannerMax) return false;
+  for (const char* c = t; c < d2; ++c) if (*c < '0' || *c > '9') return false;
+  for (const char* c = r; c < d1; ++c) if (!isalnum((unsigned char)*c)) return false;
+  for (size_t i = 0; i < slen; ++i)
+    if (!(isalnum((unsigned char)sc[i]) || sc[i] == '_' || sc[i] == '-')) return false;
+  memcpy(rfid, r, d1 - r);   rfid[d1 - r] = 0;
+  memcpy(ts14, t, 14);       ts14[14] = 0;
+  memcpy(scanner, sc, slen); scanner[slen] = 0;
+  return true;
+}
+
+static size_t fit(int n, size_t cap){ return (n > 0 && (size_t)n < cap) ? (size_t)n : 0; }
+
+size_t isoTimestamp(char* out, size_t cap, const char* ts14){
+  return fit(snprintf(out, cap, "%.4s-%.2s-%.2s %.2s:%.2s:%.2s",
+                      ts14, ts14 + 4, ts14 + 6, ts14 + 8, ts14 + 10, ts14 + 12), cap);
+}
+
+size_t csvHeader(char* out, size_t cap){
+  return fit(snprintf(out, cap, "scanner_id,rfid,timestamp,state\n"), cap);
+}
+
+size_t csvRow(char* out, size_t cap, const char* scanner, const char* rfid,
+              const char* ts14, const char* state){
+  return fit(snprintf(out, cap, "%s,%s,%.4s-%.2s-%.2s %.2s:%.2s:%.2s,%s\n",
+                      scanner, rfid, ts14, ts14 + 4, ts14 + 6, ts14 + 8, ts14 + 10, ts14 + 12,
+                      state), cap);
+}
+
+size_t ndjsonRow(char* out, size_t cap, const char* scanner, const char* rfid,
+                 const char* ts14, const char* state){
+  return fit(snprintf(out, cap,
+                      "{\"scanner_id\":\"%s\",\"rfid\":\"%s\",\"timestamp\":\"%.4s-%.2s-%.2s %.2s:%.2s:%.2s\",\"state\":\"%s\"}\n",
+                      scanner, rfid, ts14, ts14 + 4, ts14 + 6, ts14 + 8, ts14 + 10, ts14 + 12,
+                      state), cap);
+}
+
+} // namespace export_rows
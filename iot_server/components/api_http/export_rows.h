@@ -0,0 +1,29 @@
+#pragma once
+#include <stddef.h>
+
+// Spool records as /api/export rows. A spooled record lives entirely in
+// its file name, LOG.<rfid>.<YYYYMMDDHHMMSS>.<scanner>[.N], so an export
+// only reads names. Plain C++ (no Arduino), which keeps it testable and
+// benchmarkable on the host (test/test_export_rows).
+namespace export_rows {
+
+static constexpr size_t kRfidMax    = 32;
+static constexpr size_t kScannerMax = 32;
+static constexpr size_t kRowMax     = 160;   // longest row, NUL included
+
+// Splits a spool file name (path prefix allowed) into its pieces; false for
+// anything else. Buffers: rfid and scanner kRfidMax + 1 bytes, ts14 15.
+bool splitSpoolName(const char* name, char* rfid, char* ts14, char* scanner);
+
+// "YYYY-MM-DD HH:MM:SS" from ts14; returns its length, 0 if cap < 20
+size_t isoTimestamp(char* out, size_t cap, const char* ts14);
+
+// Row renderers; each returns the row length (newline included), 0 if it
+// did not fit cap. Timestamps go out as "YYYY-MM-DD HH:MM:SS".
+size_t csvHeader(char* out, size_t cap);
+size_t csvRow(char* out, size_t cap, const char* scanner, const char* rfid,
+              const char* ts14, const char* state);
+size_t ndjsonRow(char* out, size_t cap, const char* scanner, const char* rfid,
+                 const char* ts14, const char* state);
+
+} // namespace export_rows
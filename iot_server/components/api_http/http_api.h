@@ -1,11 +1,15 @@
 #pragma once
 #include "infra/log_repo.h"
 #include "services/uploader_service.h"
+#include "services/config_service.h"
 
 class HttpApi {
-  LogRepo&        repo_;
+  LogRepo&         repo_;
   UploaderService& up_;
+  ConfigService&   config_;
 public:
-  HttpApi(LogRepo& r, UploaderService& u) : repo_(r), up_(u) {}
+  HttpApi(LogRepo& r, UploaderService& u, ConfigService& c) : repo_(r), up_(u), config_(c) {}
   bool begin();
+  // Pushes a received record to /api/events; any task, never blocks
+  static void publishScan(const domain::LogEntry& e);
 };
@@ -2,13 +2,22 @@
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <WiFi.h>
-#include "infra/config_store.h"    // << NEW
 #include "infra/sd_fs.h"
 #include "infra/log_repo.h"
+#include "infra/metrics.h"
+#include "infra/spool_gen.h"
 #include "services/uploader_service.h"
+#include "services/config_service.h"
+#include "export_rows.h"
 #include <LittleFS.h>
 #include <SD.h>
 #include <esp_wifi.h>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ui_assets.h"                // generated by tools/embed_assets.py
 
 // You likely already have a shared server instance in your project;
 // if not, we create one here:
@@ -24,11 +33,6 @@ static uint8_t  g_staDiscReason = 0; // wifi_err_reason_t
 // We need access to repo/uploader that HttpApi wraps
 extern SdFsImpl SDfs;              // provided in main.cpp
 
-// --- Simple in-memory cache for small UI assets ---
-// Caches avoid repeated LittleFS opens and reduce intermittent FS timing issues
-static String s_index_html, s_login_html, s_configuration_html;
-static String s_styles_css, s_app_js, s_login_js, s_configuration_js;
-
 // Global mutex to serialize LittleFS access across tasks/handlers
 static SemaphoreHandle_t g_lfs_mutex = nullptr;
 static inline void lfs_lock(){ if (g_lfs_mutex) xSemaphoreTake(g_lfs_mutex, portMAX_DELAY); }
@@ -47,30 +51,47 @@ const char* guessMime(const String& path) {
   return "application/octet-stream";
 }
 
-static bool readAllFileFS(const char* path, String& out){
-  lfs_lock();
-  File f = LittleFS.open(path, "r");
-  if (!f) return false;
-  out.clear();
-  uint32_t fsize = (uint32_t)f.size();
-  out.reserve((size_t)fsize + 16);
-  while (f.available()){
-    char buf[512];
-    size_t n = f.readBytes(buf, sizeof(buf) - 1); // leave room for NUL
-    buf[n] = '\0';
-    if (n) out.concat(buf);
-    else break;
+// --- UI assets: gzip arrays in flash, built from data/ (ui_assets.h) ---
+// Streamed straight from flash, no heap copy. The strong ETag is computed at
+// build time, so a reload costs a 304; "?v=<ETag>" URLs (JS/CSS as the
+// pages reference them, versioned by tools/embed_assets.py) are cached for
+// a year and not even revalidated.
+static const UiAsset* findAsset(const char* path){
+  for (size_t i = 0; i < kUiAssetCount; ++i)
+    if (!strcmp(kUiAssets[i].path, path)) return &kUiAssets[i];
+  return nullptr;
+}
+
+// false when the asset is not installed (caller answers)
+static bool serveAsset(AsyncWebServerRequest* r, const char* path){
+  const UiAsset* a = findAsset(path);
+  if (!a) return false;
+  const char* cc = r->hasParam("v") ? "public, max-age=31536000, immutable" : "no-cache";
+  const AsyncWebHeader* inm = r->getHeader("If-None-Match");
+  if (inm && inm->value().indexOf(a->etag) >= 0) {
+    auto* resp = r->beginResponse(304);
+    resp->addHeader("ETag", a->etag);
+    resp->addHeader("Cache-Control", cc);
+    r->send(resp);
+    return true;
   }
-  f.close();
-  bool ok = (out.length() == (size_t)fsize);
-  lfs_unlock();
-  return ok;
+  auto* resp = r->beginResponse(200, a->mime, a->data, a->len);   // from flash
+  resp->addHeader("Content-Encoding", "gzip");
+  resp->addHeader("ETag", a->etag);
+  resp->addHeader("Cache-Control", cc);
+  resp->addHeader("Vary", "Accept-Encoding");
+  r->send(resp);
+  return true;
 }
 
 // Simple helpers
+// Serialized straight into the response buffer, sized up front; no String
+// copy in between. For lists that grow with the data use sendJsonArray().
 static void sendJson(AsyncWebServerRequest* req, int code, const JsonVariantConst& v){
-  String s; serializeJson(v, s);
-  req->send(code, "application/json", s);
+  auto* resp = req->beginResponseStream("application/json", measureJson(v) + 1);
+  resp->setCode(code);
+  serializeJson(v, *resp);
+  req->send(resp);
 }
 // Put these in the same helper section near the top of http_api_async.cpp
 static void sendJsonText(AsyncWebServerRequest* req, int code, const String& body) {
@@ -81,6 +102,240 @@ static void sendJsonText(AsyncWebServerRequest* req, int code, const String& bod
 static void sendJsonText(AsyncWebServerRequest* req, int code, const char* text){
   req->send(code, "application/json", text);
 }
+
+// JSON string literal for s, quotes and escapes included
+static String jsonQuote(const String& s){
+  JsonDocument d;
+  d.set(s);
+  String out;
+  serializeJson(d, out);
+  return out;
+}
+
+// serializeJson() into a String replaces its content; this appends, with
+// no intermediate buffer to outgrow. False if the String could not grow
+// (out then holds a truncated document).
+struct StringAppender {
+  String& s;
+  size_t write(uint8_t c){ return s.concat((char)c) ? 1 : 0; }
+  size_t write(const uint8_t* p, size_t n){ return s.concat((const char*)p, n) ? n : 0; }
+};
+static bool appendJson(String& out, JsonVariantConst v){
+  StringAppender w{out};
+  return serializeJson(v, w) == measureJson(v);
+}
+
+// --- Streamed JSON arrays ---
+// head + [ elements ] + tail as a chunked response. Elements are produced
+// one at a time by a callback while the TCP window opens, so a request
+// holds one element document and one rendered element however long the
+// list is, and nothing is rendered before the client can take it. The
+// element buffer starts at kJsonItemMax and grows for a larger element.
+static constexpr size_t kJsonItemMax = 512;
+
+// Fills item with element i; false once there are no more
+using JsonItemFn = std::function<bool(size_t i, JsonDocument& item)>;
+
+struct JsonArrayStream {
+  JsonItemFn            next;
+  std::function<void()> done;           // once the response is gone, sent or aborted
+  String                head, tail;
+  size_t                i = 0, emitted = 0;
+  uint8_t               stage = 0;      // head, elements, tail, end
+  const char*           src = nullptr;
+  size_t                len = 0, off = 0;
+  std::vector<char>     buf = std::vector<char>(kJsonItemMax + 2);
+  JsonDocument          item;
+
+  ~JsonArrayStream() { if (done) done(); }
+
+  // Points src at the next piece of output; false at the end
+  bool refill(){
+    off = len = 0;
+    if (stage == 0) { stage = 1; src = head.c_str(); len = head.length(); return true; }
+    while (stage == 1) {
+      item.clear();
+      if (!next(i++, item)) {
+        stage = 2;
+        src = emitted ? "]" : "[]"; len = emitted ? 1 : 2;
+        return true;
+      }
+      size_t need = measureJson(item);
+      if (need + 2 > buf.size()) buf.resize(need + 2);   // separator + NUL
+      size_t n = 0;
+      buf[n++] = emitted ? ',' : '[';
+      serializeJson(item, buf.data() + n, buf.size() - n);
+      emitted++;
+      src = buf.data(); len = n + need;
+      return true;
+    }
+    if (stage == 2) {
+      stage = 3;
+      src = tail.c_str(); len = tail.length();
+      return true;
+    }
+    return false;
+  }
+};
+
+// etag: sent with no-cache when set (the list is cached upstream), else no-store
+static void sendJsonArray(AsyncWebServerRequest* req, const String& head, const String& tail,
+                          JsonItemFn next, std::function<void()> done = nullptr,
+                          const String& etag = String()){
+  auto st = std::make_shared<JsonArrayStream>();
+  st->head = head;
+  st->tail = tail;
+  st->next = std::move(next);
+  st->done = std::move(done);
+  auto* resp = req->beginChunkedResponse("application/json", [st](uint8_t* out, size_t maxLen, size_t) -> size_t {
+    size_t w = 0;
+    while (w < maxLen) {
+      if (st->off == st->len && !st->refill()) break;
+      size_t n = st->len - st->off;
+      if (n > maxLen - w) n = maxLen - w;
+      memcpy(out + w, st->src + st->off, n);
+      st->off += n; w += n;
+    }
+    return w;                                 // 0 ends the response
+  });
+  if (etag.length()) { resp->addHeader("ETag", etag); resp->addHeader("Cache-Control", "no-cache"); }
+  else               resp->addHeader("Cache-Control", "no-store");
+  req->send(resp);
+}
+
+// A rendered body shared by every request for it (cache, snapshot)
+using SharedBody = std::shared_ptr<const String>;
+
+// Serves a shared body; nothing is copied per request
+static void sendShared(AsyncWebServerRequest* req, int code, const SharedBody& body, const String& etag){
+  auto* resp = req->beginResponse("application/json; charset=utf-8", body->length(),
+    [body](uint8_t* out, size_t maxLen, size_t index) -> size_t {
+      size_t n = body->length() - index;
+      if (n > maxLen) n = maxLen;
+      memcpy(out, body->c_str() + index, n);
+      return n;
+    });
+  resp->setCode(code);
+  if (etag.length()) { resp->addHeader("ETag", etag); resp->addHeader("Cache-Control", "no-cache"); }
+  else               resp->addHeader("Cache-Control", "no-store");
+  req->send(resp);
+}
+
+// --- File downloads (SD / LittleFS), streamed ---
+// The body is read straight from the file as the TCP window opens, at most
+// kStreamBlock per callback and ending on sector boundaries, with the FS
+// lock held only around each seek + read: no heap copy whatever the size,
+// and the uploader never waits long for the card. A single "bytes=" Range
+// is honoured (206 / 416); If-Range with our ETag keeps a resumed download
+// from splicing two versions of a file.
+static constexpr size_t kStreamBlock = 4096;
+static constexpr size_t kSector      = 512;
+
+struct FileStream {
+  File   f;
+  bool   sd    = true;
+  size_t first = 0;      // absolute offset of byte 0 of the body
+  size_t len   = 0;
+  void lock()   { if (sd) SDfs.lock();   else lfs_lock(); }
+  void unlock() { if (sd) SDfs.unlock(); else lfs_unlock(); }
+  ~FileStream() { if (f) { lock(); f.close(); unlock(); } }
+};
+
+enum RangeResult { RangeNone, RangeOk, RangeBad };
+
+static bool allDigits(const String& s){
+  if (!s.length()) return false;
+  for (size_t i = 0; i < s.length(); ++i) if (s[i] < '0' || s[i] > '9') return false;
+  return true;
+}
+
+// "bytes=a-b", "bytes=a-" or "bytes=-n". Several ranges, other units or bad
+// syntax are ignored (RangeNone: send the whole file), as RFC 7233 allows.
+static RangeResult parseRange(String h, size_t size, size_t& first, size_t& last){
+  h.trim();
+  if (!h.startsWith("bytes=") || h.indexOf(',') >= 0) return RangeNone;
+  int dash = h.indexOf('-', 6);
+  if (dash < 0) return RangeNone;
+  String a = h.substring(6, dash), b = h.substring(dash + 1);
+  a.trim(); b.trim();
+  if (!a.length()) {                                  // suffix: last n bytes
+    if (!allDigits(b)) return RangeNone;
+    size_t n = strtoul(b.c_str(), nullptr, 10);
+    if (!n || !size) return RangeBad;
+    if (n > size) n = size;
+    first = size - n; last = size - 1;
+    return RangeOk;
+  }
+  if (!allDigits(a) || (b.length() && !allDigits(b))) return RangeNone;
+  first = strtoul(a.c_str(), nullptr, 10);
+  last  = b.length() ? strtoul(b.c_str(), nullptr, 10) : size - 1;
+  if (last < first) return RangeNone;
+  if (first >= size) return RangeBad;
+  if (last >= size) last = size - 1;
+  return RangeOk;
+}
+
+// Answers the request in every case (404 when the file cannot be opened)
+static void sendFileStream(AsyncWebServerRequest* req, bool sd, const String& path,
+                           const char* mime, bool dl){
+  auto st = std::make_shared<FileStream>();
+  st->sd = sd;
+  if (sd) st->f = SDfs.open(path.c_str(), "r");
+  else { lfs_lock(); st->f = LittleFS.open(path.c_str(), "r"); lfs_unlock(); }
+  if (!st->f || st->f.isDirectory()) { sendJsonText(req, 404, "{\"error\":\"open_failed\"}"); return; }
+
+  st->lock();
+  const size_t size = st->f.size();
+  const unsigned long mtime = (unsigned long)st->f.getLastWrite();
+  st->unlock();
+  char etag[32];
+  snprintf(etag, sizeof(etag), "\"%x-%lx\"", (unsigned)size, mtime);
+
+  size_t first = 0, last = size ? size - 1 : 0;
+  RangeResult rr = RangeNone;
+  const AsyncWebHeader* range = req->getHeader("Range");
+  const AsyncWebHeader* ifRange = req->getHeader("If-Range");
+  if (range && (!ifRange || ifRange->value() == etag)) rr = parseRange(range->value(), size, first, last);
+  if (rr == RangeBad) {
+    auto* resp = req->beginResponse(416, "text/plain", "range not satisfiable");
+    resp->addHeader("Content-Range", String("bytes */") + String((uint32_t)size));
+    req->send(resp);
+    return;
+  }
+  st->first = first;
+  st->len   = size ? last - first + 1 : 0;
+
+  auto* resp = req->beginResponse(mime, st->len, [st](uint8_t* buf, size_t maxLen, size_t index) -> size_t {
+    size_t left = st->len - index;
+    size_t want = left < maxLen ? left : maxLen;
+    if (want > kStreamBlock) want = kStreamBlock;
+    size_t pos = st->first + index;
+    // end on a sector boundary so the next read starts on one
+    size_t tail = (pos + want) % kSector;
+    if (want > kSector && tail < want && want < left) want -= tail;
+    st->lock();
+    size_t n = st->f.seek(pos) ? st->f.read(buf, want) : 0;
+    st->unlock();
+    // a short read cannot be signalled once the length is out; the client
+    // sees a truncated body and can resume with a Range request
+    return n;
+  });
+  if (rr == RangeOk) {
+    resp->setCode(206);
+    char cr[48];
+    snprintf(cr, sizeof(cr), "bytes %u-%u/%u", (unsigned)first, (unsigned)last, (unsigned)size);
+    resp->addHeader("Content-Range", cr);
+  }
+  resp->addHeader("Accept-Ranges", "bytes");
+  resp->addHeader("ETag", etag);
+  resp->addHeader("Cache-Control", "no-store");
+  if (dl) {
+    String fname = path.substring(path.lastIndexOf('/') + 1);
+    if (!fname.length()) fname = "download.bin";
+    resp->addHeader("Content-Disposition", String("attachment; filename=\"") + fname + "\"");
+  }
+  req->send(resp);
+}
 static bool timeIsValid(){
   time_t now = time(nullptr);
   return now > 1700000000; // ~2023-11-14
@@ -131,8 +386,600 @@ static void splitLinesFromTail(const String& chunk, std::vector<String>& out, bo
   }
 }
 
+// /api/upload/status body; also the live feed's "status" event
+static void uploadStatusJson(UploaderService& up, ConfigService& config, JsonDocument& d){
+  d["enabled"] = up.isEnabled();
+
+  // Uploader cfg first; the saved config fills what it is missing
+  String api_url = String(up.cfg()->api.c_str());
+  uint32_t interval_ms = (uint32_t)up.cfg()->interval_ms;
+  if (api_url.length()==0 || interval_ms==0){
+    auto c = config.get();
+    if (api_url.length()==0) api_url = c->api_url;
+    if (interval_ms==0) interval_ms = c->upload_interval;
+  }
+
+  d["api_url"] = api_url;
+  d["interval_ms"] = interval_ms;
+  bool sta_connected = (WiFi.status() == WL_CONNECTED);
+  d["sta_connected"] = sta_connected;
+
+  bool valid = (api_url.length() > 0 && interval_ms > 1000 && sta_connected);
+  if (valid){
+    String api = api_url; api.toLowerCase();
+    if (api.indexOf("localhost")>=0 || api.indexOf("127.0.0.1")>=0){ valid = false; d["reason"] = "api_url_localhost_unreachable_from_device"; }
+  }
+  if (!valid){
+    if (d["reason"].isNull()){
+      if (api_url.length()==0) d["reason"] = "missing_api_url";
+      else if (interval_ms <= 1000) d["reason"] = "interval_too_low";
+      else if (!sta_connected) d["reason"] = "sta_not_connected";
+    }
+  }
+  d["valid"] = valid;
+
+  auto br = up.breaker();
+  JsonObject b = d["breaker"].to<JsonObject>();
+  b["state"]       = UploaderService::breakerName(br.state);
+  b["consec_fail"] = br.consec_fail;
+  b["retry_in_ms"] = br.retry_in_ms;
+  b["trips"]       = br.trips;
+  b["last_code"]   = br.last_code;
+}
+
+// --- Live feed: /api/events (Server-Sent Events) ---
+// Producers (LoRa RX task, uploader tasks) only drop a small record into a
+// bounded queue and never wait on a browser; the http_evt task formats and
+// broadcasts. Events: "scan" per received record, "upload" per batch that
+// reached the server, "status" (same body as /api/upload/status, plus
+// counters) at most once a second and only when it changed.
+// Backpressure: AsyncEventSource queues per client and drops for that client
+// alone once its queue is full; on top of that "status" is held back while
+// clients are backed up. Scans are never read back from SD.
+static AsyncEventSource   s_events("/api/events");
+static constexpr size_t   kFeedClients = 4;      // further connections are closed
+static constexpr size_t   kFeedBacklog = 8;      // avg packets queued per client
+static constexpr uint32_t kFeedStatusMs = 1000;
+enum FeedKind : uint8_t { FeedScan, FeedUpload };
+struct FeedMsg {
+  FeedKind kind;
+  char     scanner[24];
+  char     rfid[32];
+  char     ts[32];
+};
+static QueueHandle_t     s_feed_q = nullptr;
+static volatile uint32_t s_feed_scans = 0;
+static volatile uint32_t s_feed_drops = 0;      // queue full: producer did not wait
+
+struct FeedCtx { UploaderService* up; ConfigService* config; };
+
+static void feedPost(const FeedMsg& m){
+  if (!s_feed_q || xQueueSend(s_feed_q, &m, 0) != pdPASS) s_feed_drops++;
+}
+
+// --- Pending spool records, newest first ---
+// A spooled record lives entirely in its file name, so listing the recent
+// ones reads names only and keeps just the entries asked for.
+struct SpoolEntry {
+  char scanner[export_rows::kScannerMax + 1];
+  char rfid[export_rows::kRfidMax + 1];
+  char ts14[15];
+};
+
+// Newer timestamp first, then scanner, then rfid
+static bool spoolNewer(const SpoolEntry& a, const SpoolEntry& b){
+  int c = strcmp(a.ts14, b.ts14);
+  if (c) return c > 0;
+  c = strcmp(a.scanner, b.scanner);
+  if (c) return c < 0;
+  return strcmp(a.rfid, b.rfid) < 0;
+}
+
+// The `limit` newest records in /spool, newest first. The walk keeps them
+// in a heap with the oldest on top, so memory follows limit, not the spool
+// size; it stops after limit * 8 names so a huge spool does not hold the
+// card for long (the list is then the newest of those).
+static void spoolNewest(size_t limit, std::vector<SpoolEntry>& out){
+  out.clear();
+  if (!limit) return;
+  out.reserve(limit + 1);
+  SDfs.lock();
+  File dir = SDfs.isMounted() ? SD.open("/spool") : File();
+  if (!dir || !dir.isDirectory()) {
+    if (dir) dir.close();
+    SDfs.unlock();
+    return;
+  }
+  SdWalkYield walk(SDfs);
+  size_t seen = 0;
+  SpoolEntry e;
+  for (;;) {
+    bool isDir = false;
+    String name = dir.getNextFileName(&isDir);
+    if (!name.length()) break;
+    if (!isDir && export_rows::splitSpoolName(name.c_str(), e.rfid, e.ts14, e.scanner)) {
+      out.push_back(e);
+      std::push_heap(out.begin(), out.end(), spoolNewer);
+      if (out.size() > limit) { std::pop_heap(out.begin(), out.end(), spoolNewer); out.pop_back(); }
+      if (++seen >= limit * 8) break;
+    }
+    if (walk.restart()) { out.clear(); seen = 0; dir.rewindDirectory(); }
+  }
+  dir.close();
+  SDfs.unlock();
+  std::sort_heap(out.begin(), out.end(), spoolNewer);
+}
+
+// --- Dashboard snapshot: /api/dashboard ---
+// Everything the home page needs in one body: upload status, the last
+// upload, Wi-Fi, counters and the most recent scans. The http_evt task
+// rebuilds it when one of those changes (scan, upload result, status tick)
+// and publishes it as a shared immutable String; a request only copies a
+// pointer, with no SD, config or JSON work. The recent list is seeded once
+// from the spool at start, then kept from ingest events alone.
+static constexpr size_t  kDashRecent = 20;         // data/js/app.js keeps as many rows
+static FeedMsg           s_recent[kDashRecent];  // ring; newest at s_recent_head - 1
+static size_t            s_recent_n    = 0;
+static size_t            s_recent_head = 0;
+static SemaphoreHandle_t s_dash_mtx    = nullptr;
+static SharedBody        s_dash_body;
+static uint32_t          s_dash_ver    = 0;
+
+static void dashRemember(const FeedMsg& m){
+  s_recent[s_recent_head] = m;
+  s_recent_head = (s_recent_head + 1) % kDashRecent;
+  if (s_recent_n < kDashRecent) s_recent_n++;
+}
+
+static void dashSeed(){
+  std::vector<SpoolEntry> rows;
+  spoolNewest(kDashRecent, rows);
+  for (size_t i = rows.size(); i-- > 0; ) {            // oldest first
+    FeedMsg m{};
+    m.kind = FeedScan;
+    strlcpy(m.scanner, rows[i].scanner, sizeof(m.scanner));
+    strlcpy(m.rfid,    rows[i].rfid,    sizeof(m.rfid));
+    export_rows::isoTimestamp(m.ts, sizeof(m.ts), rows[i].ts14);
+    dashRemember(m);
+  }
+}
+
+static void dashPublish(FeedCtx& ctx, const String& status){
+  String out;
+  if (!out.reserve(status.length() + 512 + s_recent_n * 96)) return;   // keep the last body
+  bool ok = true;
+  out += "{\"status\":";
+  out += status.length() ? status : String("{}");
+
+  JsonDocument d;
+  {
+    auto snap = ctx.up->debug();
+    d["last_ms"]  = snap->last_ms;
+    d["success"]  = snap->success;
+    d["code"]     = snap->code;
+    d["error"]    = snap->error.c_str();
+    d["scanner"]  = snap->scanner.c_str();
+    d["items"]    = (uint32_t)snap->items;
+    d["accepted"] = (uint32_t)snap->accepted;
+    d["rejected"] = (uint32_t)snap->rejected;
+  }
+  out += ",\"last\":";
+  ok &= appendJson(out, d);
+
+  d.clear();
+  bool sta = (WiFi.status() == WL_CONNECTED);
+  d["sta_connected"] = sta;
+  if (sta) {
+    d["ssid"] = WiFi.SSID();
+    d["ip"]   = WiFi.localIP().toString();
+    d["rssi"] = WiFi.RSSI();
+  }
+  d["time_valid"] = timeIsValid();
+  out += ",\"wifi\":";
+  ok &= appendJson(out, d);
+
+  out += ",\"recent\":[";
+  for (size_t i = 0; i < s_recent_n; ++i) {             // newest first
+    const FeedMsg& m = s_recent[(s_recent_head + kDashRecent - 1 - i) % kDashRecent];
+    d.clear();
+    d["scanner_id"] = m.scanner;
+    d["rfid"]       = m.rfid;
+    d["timestamp"]  = m.ts;
+    if (i) out += ',';
+    ok &= appendJson(out, d);
+  }
+  out += "]}";
+  if (!ok) return;                                      // out of heap: keep the last body
+
+  auto body = std::make_shared<const String>(std::move(out));
+  xSemaphoreTake(s_dash_mtx, portMAX_DELAY);
+  s_dash_body = body;
+  s_dash_ver++;
+  xSemaphoreGive(s_dash_mtx);
+}
+
+static void feedTask(void* arg){
+  auto* ctx = static_cast<FeedCtx*>(arg);
+  uint32_t id = 0, lastStatus = 0;
+  String prevStatus, prevSent;
+  dashSeed();
+  bool dashDirty = true;
+  for(;;){
+    FeedMsg m;
+    bool got = xQueueReceive(s_feed_q, &m, pdMS_TO_TICKS(kFeedStatusMs)) == pdPASS;
+
+    if (got && m.kind == FeedScan) {
+      dashRemember(m);
+      dashDirty = true;
+      if (s_events.count()) {
+        JsonDocument d;
+        d["scanner_id"] = m.scanner;
+        d["rfid"]       = m.rfid;
+        d["timestamp"]  = m.ts;
+        String out; serializeJson(d, out);
+        s_events.send(out.c_str(), "scan", ++id);
+      }
+    } else if (got && m.kind == FeedUpload) {
+      dashDirty = true;
+      if (s_events.count()) {
+        auto snap = ctx->up->debug();
+        JsonDocument d;
+        d["success"]  = snap->success;
+        d["code"]     = snap->code;
+        d["scanner"]  = snap->scanner;
+        d["items"]    = snap->items;
+        d["accepted"] = snap->accepted;
+        d["rejected"] = snap->rejected;
+        d["backlog"]  = snap->backlog;
+        String out; serializeJson(d, out);
+        s_events.send(out.c_str(), "upload", ++id);
+      }
+      lastStatus = 0;                        // breaker/backlog may have moved
+    }
+
+    if (!lastStatus || millis() - lastStatus >= kFeedStatusMs) {
+      lastStatus = millis();
+      JsonDocument d;
+      uploadStatusJson(*ctx->up, *ctx->config, d);
+      {
+        auto snap = ctx->up->debug();
+        d["backlog"]    = snap->backlog;
+        d["dead_total"] = snap->dead_total;
+      }
+      d["scans"]   = s_feed_scans;
+      d["dropped"] = s_feed_drops;
+      d["clients"] = (uint32_t)s_events.count();
+      String out; serializeJson(d, out);
+      if (out != prevStatus) { prevStatus = out; dashDirty = true; }
+      // held back while clients are backed up; sent on a later tick
+      if (s_events.count() && out != prevSent && s_events.avgPacketsWaiting() <= kFeedBacklog) {
+        prevSent = out;
+        s_events.send(out.c_str(), "status", ++id);
+      }
+    }
+
+    if (dashDirty) { dashPublish(*ctx, prevStatus); dashDirty = false; }
+  }
+}
+
+void HttpApi::publishScan(const domain::LogEntry& e){
+  FeedMsg m{};
+  m.kind = FeedScan;
+  strlcpy(m.scanner, e.scanner_id.c_str(), sizeof(m.scanner));
+  strlcpy(m.rfid,    e.rfid.c_str(),       sizeof(m.rfid));
+  strlcpy(m.ts,      e.ts_iso.c_str(),     sizeof(m.ts));
+  s_feed_scans++;
+  feedPost(m);
+}
+
+// --- Jobs: slow handlers off the async_tcp task ---
+// Anything that walks an SD directory or waits on the network is queued to
+// a small pool of http_job tasks instead of running in the request handler,
+// so one directory scan no longer stalls every other connection and the TCP
+// stack. By default the request is paused and answered by the worker when
+// it finishes (the client just sees a slower response). With
+// "Prefer: respond-async" the answer is 202 + Location: /api/jobs/<id>
+// right away, and the result is polled there. The job table is fixed-size;
+// finished jobs are recycled oldest first, and when every slot is queued
+// or running the request gets 503 + Retry-After.
+static constexpr size_t kJobSlots   = 8;
+static constexpr size_t kJobWorkers = 2;
+
+struct JobResult {
+  int         code = 200;
+  const char* mime = "application/json";
+  String      body;
+  String      etag;                          // sent as ETag when set
+};
+using JobFn = std::function<void(JobResult&)>;
+
+enum JobState : uint8_t { JobQueued, JobRunning, JobDone };
+struct Job {
+  uint32_t                 id    = 0;
+  const char*              name  = "";
+  JobState                 state = JobQueued;
+  uint32_t                 queued_ms = 0;
+  uint32_t                 done_ms   = 0;
+  JobFn                    fn;
+  JobResult                res;
+  AsyncWebServerRequestPtr waiter;            // empty for 202 jobs
+  bool                     detached = false;  // 202: keep the body for polling
+};
+
+static Job*              s_jobs[kJobSlots] = {};
+static SemaphoreHandle_t s_jobs_mtx = nullptr;
+static QueueHandle_t     s_job_q    = nullptr;
+static uint32_t          s_job_seq  = 0;
+
+static const char* jobStateName(JobState s){
+  switch (s) {
+    case JobQueued:  return "queued";
+    case JobRunning: return "running";
+    default:         return "done";
+  }
+}
+
+// 0 when every slot is taken by a queued/running job
+static uint32_t submitJob(const char* name, JobFn fn, AsyncWebServerRequestPtr waiter){
+  if (!s_job_q) return 0;
+  xSemaphoreTake(s_jobs_mtx, portMAX_DELAY);
+  int slot = -1;
+  for (size_t i = 0; i < kJobSlots; ++i) {
+    if (!s_jobs[i]) { slot = (int)i; break; }
+    if (s_jobs[i]->state == JobDone &&
+        (slot < 0 || (int32_t)(s_jobs[i]->done_ms - s_jobs[slot]->done_ms) < 0))
+      slot = (int)i;                          // oldest finished one
+  }
+  if (slot < 0) { xSemaphoreGive(s_jobs_mtx); return 0; }
+  delete s_jobs[slot];
+  Job* j = new Job();
+  j->id = ++s_job_seq;
+  if (!j->id) j->id = ++s_job_seq;            // 0 means "no job"
+  j->name = name;
+  j->queued_ms = millis();
+  j->fn = std::move(fn);
+  j->detached = waiter.expired();
+  j->waiter = std::move(waiter);
+  s_jobs[slot] = j;
+  uint32_t id = j->id;
+  // the queue holds kJobSlots, so a free slot means room in the queue
+  xQueueSend(s_job_q, &j, 0);
+  xSemaphoreGive(s_jobs_mtx);
+  return id;
+}
+
+static void jobTask(void*){
+  for(;;){
+    Job* j = nullptr;
+    if (xQueueReceive(s_job_q, &j, portMAX_DELAY) != pdPASS || !j) continue;
+    xSemaphoreTake(s_jobs_mtx, portMAX_DELAY);
+    j->state = JobRunning;
+    xSemaphoreGive(s_jobs_mtx);
+
+    JobResult r;
+    j->fn(r);
+    j->fn = nullptr;
+    // client may have gone away meanwhile; then there is no one to answer
+    if (auto req = j->waiter.lock()) {
+      auto* resp = req->beginResponse(r.code, r.mime, r.body);
+      if (r.etag.length()) { resp->addHeader("ETag", r.etag); resp->addHeader("Cache-Control", "no-cache"); }
+      else                 resp->addHeader("Cache-Control", "no-store");
+      req->send(resp);
+    }
+
+    // once done the slot may be recycled: j is not touched after this
+    xSemaphoreTake(s_jobs_mtx, portMAX_DELAY);
+    j->waiter.reset();
+    j->res.code = r.code;
+    if (j->detached) { j->res.mime = r.mime; j->res.body = std::move(r.body); }
+    j->done_ms = millis();
+    j->state = JobDone;
+    xSemaphoreGive(s_jobs_mtx);
+  }
+}
+
+// Runs fn on a job worker and answers req from there (or 202, see above).
+// false: no free slot, req has been answered 503 and fn will not run.
+static bool deferToJob(AsyncWebServerRequest* req, const char* name, JobFn fn){
+  const AsyncWebHeader* prefer = req->getHeader("Prefer");
+  const bool async = prefer && prefer->value().indexOf("respond-async") >= 0;
+  AsyncWebServerRequestPtr waiter;
+  if (!async) waiter = req->pause();
+  uint32_t id = submitJob(name, std::move(fn), waiter);
+  if (!id) {
+    auto* resp = req->beginResponse(503, "application/json", "{\"error\":\"busy\"}");
+    resp->addHeader("Retry-After", "1");
+    req->send(resp);
+    return false;
+  }
+  if (!async) return true;
+  String href = String("/api/jobs/") + String(id);
+  String body = String("{\"job\":") + String(id) + ",\"href\":\"" + href + "\"}";
+  auto* resp = req->beginResponse(202, "application/json", body);
+  resp->addHeader("Location", href);
+  resp->addHeader("Cache-Control", "no-store");
+  req->send(resp);
+  return true;
+}
+
+// GET /api/jobs/<id>: state, and the handler's status + body once done
+static void sendJobStatus(AsyncWebServerRequest* req){
+  String url = req->url();
+  int slash = url.lastIndexOf('/');
+  uint32_t id = (slash >= 0) ? (uint32_t)strtoul(url.c_str() + slash + 1, nullptr, 10) : 0;
+  String out;
+  xSemaphoreTake(s_jobs_mtx, portMAX_DELAY);
+  for (Job* j : s_jobs) {
+    if (!j || j->id != id || !id) continue;
+    out = String("{\"job\":") + String(j->id) + ",\"name\":\"" + j->name +
+          "\",\"state\":\"" + jobStateName(j->state) + "\",\"age_ms\":" + String(millis() - j->queued_ms);
+    if (j->state == JobDone) {
+      out += ",\"code\":" + String(j->res.code);
+      if (j->detached) {
+        out += ",\"result\":";
+        bool json = !strncmp(j->res.mime, "application/json", 16) && j->res.body.length();
+        if (json) out += j->res.body;
+        else out += jsonQuote(j->res.body);
+      }
+    }
+    out += "}";
+    break;
+  }
+  xSemaphoreGive(s_jobs_mtx);
+  if (!out.length()) { sendJsonText(req, 404, "{\"error\":\"no_such_job\"}"); return; }
+  sendJsonText(req, 200, out);
+}
+
+using export_rows::splitSpoolName;
+
+// --- /api/logs: spool listing cache + single flight ---
+// One cached listing, tagged with the spool generation it was scanned at,
+// and at most one scan in flight; every request for that query, the one
+// that started it included, waits for its result instead of walking /spool
+// again. The scan yields SpoolEntry records (81 bytes each), shared by all
+// of those requests; each response renders them one element at a time
+// through sendJsonArray, so no request holds the JSON body. Only listings
+// of up to kLogsCacheRows (the UI's default poll) stay cached; a larger one
+// is freed once the last response has gone out.
+static constexpr size_t kLogsCacheRows  = 100;
+static constexpr size_t kLogsHeapMargin = 16 * 1024;   // left free after the listing
+
+using SpoolList = std::shared_ptr<const std::vector<SpoolEntry>>;
+struct LogsCache  { uint32_t gen = 0; size_t limit = 0; SpoolList list; };
+struct LogsFlight { uint32_t gen; size_t limit; std::vector<AsyncWebServerRequestPtr> waiters; };
+static SemaphoreHandle_t s_logs_mtx    = nullptr;
+static LogsCache         s_logs_cache;
+static LogsFlight*       s_logs_flight = nullptr;
+static uint32_t          s_boot_tag    = 0;      // keeps ETags from matching across reboots
+
+static String logsEtag(uint32_t gen, size_t limit){
+  char b[40];
+  snprintf(b, sizeof(b), "\"%08x-%x-%u\"", (unsigned)s_boot_tag, (unsigned)gen, (unsigned)limit);
+  return String(b);
+}
+
+static void sendLogs(AsyncWebServerRequest* req, const SpoolList& list, const String& etag){
+  sendJsonArray(req, "", "", [list, iso = std::array<char, 20>()](size_t i, JsonDocument& o) mutable {
+    if (i >= list->size()) return false;
+    const SpoolEntry& e = (*list)[i];
+    export_rows::isoTimestamp(iso.data(), iso.size(), e.ts14);
+    o["scanner_id"] = e.scanner;
+    o["rfid"]       = e.rfid;
+    o["timestamp"]  = iso.data();         // derived from filename
+    o["code"]       = 0;
+    o["msg"]        = "";
+    return true;
+  }, nullptr, etag);
+}
+
+// Called with s_logs_mtx held; releases it, then answers the waiters with
+// list, or with code and error when there is none
+static void finishLogsFlight(LogsFlight* fl, const SpoolList& list, const String& etag,
+                             int code = 200, const char* error = nullptr){
+  if (s_logs_flight == fl) s_logs_flight = nullptr;
+  std::vector<AsyncWebServerRequestPtr> waiters = std::move(fl->waiters);
+  xSemaphoreGive(s_logs_mtx);
+  delete fl;
+  for (auto& w : waiters) {
+    auto req = w.lock();
+    if (!req) continue;
+    if (list) sendLogs(req.get(), list, etag);
+    else      sendJsonText(req.get(), code, String("{\"error\":\"") + error + "\"}");
+  }
+}
+
+// --- /api/export: bulk download of the spooled records ---
+// Walks /spool (pending) and then the dead-letter directory by name only:
+// the record is in the file name, so no file is opened. At most
+// kExportStep names are read per SD lock hold and matching rows go
+// straight into the response as the client takes them, so memory stays
+// constant whatever the row count and LoRa ingest waits at most one step
+// for the card. Records already delivered are not on SD any more, so they
+// are not part of an export.
+//
+// The walk cannot restart after the card was released (rows are already
+// sent), so it does not yield inside a step and carries on between steps
+// from FAT's directory slot index, which creating or deleting other
+// entries does not move. A record present for the whole export is listed
+// exactly once; one spooled or acked during it may or may not be, and one
+// quarantined during it can be listed both as pending and as dead.
+static constexpr size_t kExportStep   = 32;
+
+struct ExportStream {
+  String   dirs[2];                 // pending, dead
+  uint8_t  phase  = 0;              // index into dirs; 2 = done
+  bool     opened = false;
+  File     dir;
+  bool     csv    = false;
+  bool     header = false;
+  char     from[15], to[15];
+  String   scanner;
+  char     row[export_rows::kRowMax];
+  size_t   rlen = 0, roff = 0;
+  uint32_t rows = 0, bytes = 0, t0 = 0;
+
+  ~ExportStream() {
+    if (dir) { SDfs.lock(); dir.close(); SDfs.unlock(); }
+    uint32_t ms = millis() - t0;
+    uint32_t bps = ms ? (uint32_t)((uint64_t)bytes * 1000 / ms) : bytes;
+    metrics::export_bytes.inc(bytes);
+    metrics::export_rate.set((int32_t)bps);
+    Serial.printf("[HTTP] export: %u rows, %u bytes in %u ms (%.2f MB/s)\n",
+                  (unsigned)rows, (unsigned)bytes, (unsigned)ms, bps / 1e6);
+  }
+
+  // Renders the next row into row[]; false once both directories are done
+  bool fill() {
+    rlen = roff = 0;
+    if (csv && !header) {
+      header = true;
+      rlen = export_rows::csvHeader(row, sizeof(row));
+      return true;
+    }
+    char rfid[33], ts14[15], sc[33];
+    while (phase < 2) {
+      bool found = false;
+      SDfs.lock();
+      for (size_t n = 0; n < kExportStep && phase < 2 && !found; ++n) {
+        if (!opened) {
+          opened = true;
+          dir = SDfs.isMounted() ? SD.open(dirs[phase].c_str()) : File();
+          if (!dir || !dir.isDirectory()) { if (dir) dir.close(); phase++; opened = false; continue; }
+        }
+        bool isDir = false;
+        String name = dir.getNextFileName(&isDir);
+        if (!name.length()) { dir.close(); phase++; opened = false; continue; }
+        if (isDir || !splitSpoolName(name.c_str(), rfid, ts14, sc)) continue;
+        if (strcmp(ts14, from) < 0 || strcmp(ts14, to) > 0) continue;
+        if (scanner.length() && scanner != sc) continue;
+        found = true;
+      }
+      SDfs.unlock();
+      if (found) {
+        const char* state = phase == 0 ? "pending" : "dead";
+        rlen = csv ? export_rows::csvRow(row, sizeof(row), sc, rfid, ts14, state)
+                   : export_rows::ndjsonRow(row, sizeof(row), sc, rfid, ts14, state);
+        rows++;
+        return true;
+      }
+      // a whole step without a match: let the tasks waiting for the card in
+      if (phase < 2) vTaskDelay(1);
+    }
+    return false;
+  }
+};
+
+// "2024-05-01", "2024-05-01 08:00", "20240501080000", ...: the digits,
+// padded to 14 with pad, so "to" covers the whole day / hour / minute given
+static void exportBound(const String& in, char pad, char out[15]){
+  size_t n = 0;
+  for (size_t i = 0; i < in.length() && n < 14; ++i) if (isdigit((unsigned char)in[i])) out[n++] = in[i];
+  while (n < 14) out[n++] = pad;
+  out[14] = 0;
+}
+
 // ---- REST ----
-static void installWifiRoutes(ConfigStore& store){
+static void installWifiRoutes(ConfigService& config){
   // GET /api/wifi/status
   server.on("/api/wifi/status", HTTP_GET, [&](AsyncWebServerRequest* req){
     StaticJsonDocument<384> doc;
@@ -175,19 +1022,15 @@ static void installWifiRoutes(ConfigStore& store){
       return;
     }
     if (st >= 0){
-      StaticJsonDocument<4096> out;
-      JsonArray arr = out.to<JsonArray>();
-      for (int i=0;i<st;i++){
-        JsonObject o = arr.createNestedObject();
+      sendJsonArray(req, "", "", [st](size_t i, JsonDocument& o){
+        if ((int)i >= st) return false;
         o["ssid"] = WiFi.SSID(i);
         o["rssi"] = WiFi.RSSI(i);
         o["channel"] = WiFi.channel(i);
         o["hidden"] = (WiFi.SSID(i).length() == 0);
         o["auth"] = authModeName((wifi_auth_mode_t)WiFi.encryptionType(i));
-      }
-      // free results
-      WiFi.scanDelete();
-      sendJson(req, 200, out.as<JsonVariantConst>());
+        return true;
+      }, []{ WiFi.scanDelete(); });            // free results once sent
       return;
     }
     // Should not happen; ensure we re-trigger
@@ -195,7 +1038,7 @@ static void installWifiRoutes(ConfigStore& store){
     req->send(200, "application/json", "{\"running\":true}");
   });
 
-  // POST /api/wifi/save  {ssid, password|pass} -> persist STA creds into SD:/config.json
+  // POST /api/wifi/save  {ssid, password|pass} -> persist STA creds (config service)
   server.on("/api/wifi/save", HTTP_POST, [](AsyncWebServerRequest* req){},
     nullptr,
     [&](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total){
@@ -206,14 +1049,9 @@ static void installWifiRoutes(ConfigStore& store){
       StaticJsonDocument<256> in;
       bool ok=false;
       if (!deserializeJson(in, *buf)){
-        const char* ssid = in["ssid"] | "";
-        const char* pass = in["password"] | (const char*)(in["pass"] | "");
-        StaticJsonDocument<512> cfg;
-        const char* CFG_JSON = "/config.json";
-        { String raw; if (SDfs.readAll(CFG_JSON, raw)) deserializeJson(cfg, raw); }
-        cfg["wifi_sta_ssid"] = ssid;
-        cfg["wifi_sta_password"] = pass;
-        { String tmp; serializeJson(cfg, tmp); ok = SDfs.writeAll(CFG_JSON, tmp); }
+        String ssid = (const char*)(in["ssid"] | "");
+        String pass = (const char*)(in["password"] | (const char*)(in["pass"] | ""));
+        ok = config.update([&](AppConfig& c){ c.wifi_sta_ssid = ssid; c.wifi_sta_password = pass; });
       }
       delete buf; req->_tempObject=nullptr;
       if(!ok){ req->send(500, "text/plain", "save failed"); return; }
@@ -240,15 +1078,11 @@ static void installWifiRoutes(ConfigStore& store){
         }
       }
       delete buf; req->_tempObject=nullptr;
-      // Fill missing fields from saved creds on SD:/config.json
+      // Fill missing fields from the saved creds
       if(!ssid.length() || !pass.length()){
-        const char* CFG_JSON = "/config.json";
-        String raw; if (SDfs.readAll(CFG_JSON, raw)){
-          StaticJsonDocument<256> d; if(!deserializeJson(d,raw)){
-            if(!ssid.length()) ssid = (const char*)(d["wifi_sta_ssid"] | "");
-            if(!pass.length()) pass = (const char*)(d["wifi_sta_password"] | "");
-          }
-        }
+        auto c = config.get();
+        if(!ssid.length()) ssid = c->wifi_sta_ssid;
+        if(!pass.length()) pass = c->wifi_sta_password;
       }
       if(!ssid.length()){ req->send(400, "text/plain", "no ssid"); return; }
       if(!pass.length()){
@@ -281,14 +1115,14 @@ static void installWifiRoutes(ConfigStore& store){
       sendJson(req, 200, doc.as<JsonVariantConst>());
     });
 
-  // GET /api/wifi/creds  -> debug helper to read saved wifi.json
+  // GET /api/wifi/creds  -> debug helper: saved STA creds (password length only)
   server.on("/api/wifi/creds", HTTP_GET, [&](AsyncWebServerRequest* req){
-    WifiCfg c; ConfigStore st;
+    auto c = config.get();
     StaticJsonDocument<256> out;
-    if (st.loadWifi(c)){
-      out["ssid"] = c.ssid.c_str();
+    if (c->wifi_sta_ssid.length()){
+      out["ssid"] = c->wifi_sta_ssid;
       out["present"] = true;
-      out["len"] = (uint32_t)c.pass.size();
+      out["len"] = (uint32_t)c->wifi_sta_password.length();
     } else {
       out["present"] = false;
     }
@@ -307,12 +1141,14 @@ static void installWifiRoutes(ConfigStore& store){
   server.on("/api/time/sync", HTTP_POST, [&](AsyncWebServerRequest* req){
     if(WiFi.status()!=WL_CONNECTED){ req->send(409, "text/plain", "sta not connected"); return; }
     configTime(0,0,"pool.ntp.org","time.google.com");
-    // don't block forever
-    uint32_t t0=millis();
-    while(!timeIsValid() && (millis()-t0)<10000){ delay(200); }
-    StaticJsonDocument<128> doc;
-    doc["time_valid"] = timeIsValid();
-    sendJson(req, 200, doc.as<JsonVariantConst>());
+    // waiting for SNTP (up to 10 s) happens on a job worker
+    deferToJob(req, "time_sync", [](JobResult& res){
+      uint32_t t0=millis();
+      while(!timeIsValid() && (millis()-t0)<10000){ vTaskDelay(pdMS_TO_TICKS(200)); }
+      JsonDocument doc;
+      doc["time_valid"] = timeIsValid();
+      serializeJson(doc, res.body);
+    });
   });
 }
 
@@ -371,33 +1207,11 @@ bool HttpApi::begin(){
   }
   if (lfs_ok) { lfs_lock(); LittleFS.mkdir("/js"); lfs_unlock(); }
 
-  static ConfigStore cfg; // uses LittleFS for wifi.json
-  // Ensure a default config.json exists so reads don't spam errors on first boot
-  if (lfs_ok) {
-    const char* kCfg = "/config.json";
-    lfs_lock();
-    bool exists = LittleFS.exists(kCfg);
-    if (!exists) {
-      File f = LittleFS.open(kCfg, "w");
-      if (f) {
-        StaticJsonDocument<256> d;
-        d["user"] = "admin";
-        d["pass"] = "admin";
-        d["apiUrl"] = "";
-        d["intervalMs"] = 15000;
-        serializeJson(d, f);
-        f.close();
-      }
-    }
-    lfs_unlock();
-  }
-  installWifiRoutes(cfg);
+  installWifiRoutes(config_);
 
   // === Auth + Config + Logs (for frontend) ===
+  // Credentials come from the config service (RAM), no file access per request
   static bool isLoggedIn = false;
-  static String authUser = "admin";
-  static String authPass = "admin";
-  const char* CFG_JSON = "/config.json";
 
   auto hasSession = [](AsyncWebServerRequest* req){
     if (req->hasHeader("Cookie")){
@@ -408,29 +1222,6 @@ bool HttpApi::begin(){
     return false;
   };
 
-  auto loadAuthFromFile = [&](){
-    if (!lfs_ok) return;
-    File f = LittleFS.open(CFG_JSON, "r"); if(!f) return;
-    StaticJsonDocument<256> d; if (deserializeJson(d,f)) { f.close(); return; }
-    f.close();
-    authUser = String((const char*)(d["user"] | authUser.c_str()));
-    authPass = String((const char*)(d["pass"] | authPass.c_str()));
-  };
-  loadAuthFromFile();
-
-
-  auto saveAuthToFile = [&](){
-    if (!lfs_ok) return;
-    // merge with existing
-    StaticJsonDocument<256> d;
-    File fr = LittleFS.open(CFG_JSON, "r");
-    if (fr){ deserializeJson(d, fr); fr.close(); }
-    d["user"] = authUser;
-    d["pass"] = authPass;
-    File fw = LittleFS.open(CFG_JSON, "w"); if(!fw) return;
-    serializeJson(d, fw); fw.close();
-  };
-
   // /api/login
   server.on("/api/login", HTTP_POST,
     [](AsyncWebServerRequest* /*req*/){}, nullptr,
@@ -438,7 +1229,7 @@ bool HttpApi::begin(){
       StaticJsonDocument<256> d; if (deserializeJson(d, data, len)) { sendJsonText(req,400,"{\"error\":\"missing\"}"); return; }
       String u = String((const char*)(d["username"] | ""));
       String p = String((const char*)(d["password"] | ""));
-      if (u == authUser && p == authPass){
+      if (config_.checkLogin(u, p)){
         isLoggedIn = true;
         auto* resp = req->beginResponse(200, "application/json", "{\"ok\":true}");
         resp->addHeader("Set-Cookie", "SID=1; Path=/");
@@ -460,62 +1251,24 @@ bool HttpApi::begin(){
   // /api/me
   server.on("/api/me", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
     if (!(isLoggedIn || hasSession(req))) { sendJsonText(req,401,"{\"error\":\"unauthorized\"}"); return; }
-    StaticJsonDocument<128> d; d["user"] = authUser; sendJson(req,200,d.as<JsonVariantConst>());
+    JsonDocument d; d["user"] = config_.get()->auth_user; sendJson(req,200,d.as<JsonVariantConst>());
   });
 
-  // /api/config GET (stored on SD as /config.json) with legacy mapping + default fill
+  // /api/config GET (served from RAM; legacy keys were mapped at load)
   server.on("/api/config", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
     if (!(isLoggedIn || hasSession(req))) { sendJsonText(req,401,"{\"error\":\"unauthorized\"}"); return; }
-    const char* CFG_JSON = "/config.json";
-    StaticJsonDocument<512> src; 
-    bool existed=false;
-    {
-      String raw;
-      if (SDfs.readAll(CFG_JSON, raw)) { 
-        deserializeJson(src, raw); 
-        existed=true; 
-      }
-    }
-
-    // Build normalized view with defaults and legacy fallbacks
     StaticJsonDocument<512> out;
-    out["auth_user"]        = src["auth_user"]        | src["user"]        | "admin";
-    out["auth_password"]    = src["auth_password"]    | src["pass"]        | "admin";
-    out["wifi_ap_ssid"]     = src["wifi_ap_ssid"]     | "Device-Portal";
-    out["wifi_ap_password"] = src["wifi_ap_password"] | "12345678";
-    out["wifi_sta_ssid"]    = src["wifi_sta_ssid"]    | src["ssid"]       | "";
-    out["wifi_sta_password"]= src["wifi_sta_password"]| src["password"]   | "";
-    out["api_url"]          = src["api_url"]          | src["apiUrl"]     | "";
-    out["upload_interval"]  = src["upload_interval"]  | src["intervalMs"] | 0;
-
-    // Persist migration/backfill so future reads see normalized keys
-    if (!existed ||
-        !src.containsKey("auth_user") || !src.containsKey("auth_password") ||
-        !src.containsKey("wifi_ap_ssid") || !src.containsKey("wifi_ap_password") ||
-        !src.containsKey("wifi_sta_ssid") || !src.containsKey("wifi_sta_password") ||
-        !src.containsKey("api_url") || !src.containsKey("upload_interval")){
-      String tmp; serializeJson(out, tmp);
-      SDfs.writeAll(CFG_JSON, tmp);
-    }
-
+    ConfigService::toJson(*config_.get(), out);
     sendJson(req,200,out.as<JsonVariantConst>());
   });
 
-  // /api/config POST (partial updates; persist on SD)
+  // /api/config POST (partial updates; written through to SD only if something changed)
   server.on("/api/config", HTTP_POST,
     [&, hasSession](AsyncWebServerRequest* req){ if (!(isLoggedIn || hasSession(req))) { sendJsonText(req,403,"{\"error\":\"unauthorized\"}"); return; } },
     nullptr,
-    [&, hasSession, saveAuthToFile, this](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t, size_t){
+    [&, hasSession, this](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t, size_t){
       if (!(isLoggedIn || hasSession(req))) { sendJsonText(req,403,"{\"error\":\"unauthorized\"}"); return; }
       StaticJsonDocument<512> in; if (deserializeJson(in,data,len)) { sendJsonText(req,400,"{\"error\":\"bad json\"}"); return; }
-      // merge existing
-      StaticJsonDocument<512> cfgDoc;
-      const char* CFG_JSON = "/config.json";
-      {
-        String raw; if (SDfs.readAll(CFG_JSON, raw)) { deserializeJson(cfgDoc, raw); }
-      }
-
-      bool authChanged=false, uploaderChanged=false, apChanged=false;
 
       // Type-scoped updates: "auth" | "ap" | "sta" | "api". If missing, allow all (back-compat)
       String type = String((const char*)(in["type"] | ""));
@@ -524,50 +1277,39 @@ bool HttpApi::begin(){
       bool allowSta  = !type.length() || type == "sta";
       bool allowApi  = !type.length() || type == "api";
 
-      // Track previous AP values to detect change
-      String prevApSsid = String((const char*)(cfgDoc["wifi_ap_ssid"] | ""));
-      String prevApPass = String((const char*)(cfgDoc["wifi_ap_password"] | ""));
-
-      // New fields (SD-backed), scoped by type
-      if (allowAuth && in.containsKey("auth_user")) { authUser = String((const char*)in["auth_user"]); cfgDoc["auth_user"] = authUser; authChanged=true; }
-      if (allowAuth && in.containsKey("auth_password")) { authPass = String((const char*)in["auth_password"]); cfgDoc["auth_password"] = authPass; authChanged=true; }
-      if (allowAp   && in.containsKey("wifi_ap_ssid")) cfgDoc["wifi_ap_ssid"] = (const char*)in["wifi_ap_ssid"];
-      if (allowAp   && in.containsKey("wifi_ap_password")) cfgDoc["wifi_ap_password"] = (const char*)in["wifi_ap_password"];
-      if (allowSta  && in.containsKey("wifi_sta_ssid")) cfgDoc["wifi_sta_ssid"] = (const char*)in["wifi_sta_ssid"];
-      if (allowSta  && in.containsKey("wifi_sta_password")) cfgDoc["wifi_sta_password"] = (const char*)in["wifi_sta_password"];
-      if (allowApi  && in.containsKey("api_url")) { cfgDoc["api_url"] = (const char*)in["api_url"]; uploaderChanged=true; }
-      if (allowApi  && in.containsKey("upload_interval")) { cfgDoc["upload_interval"] = (uint32_t)in["upload_interval"]; uploaderChanged=true; }
-
-      // Legacy keys (map to new), scoped by type
-      if (allowAuth && in.containsKey("user")) { authUser = String((const char*)in["user"]); cfgDoc["auth_user"] = authUser; authChanged=true; }
-      if (allowAuth && in.containsKey("pass")) { authPass = String((const char*)in["pass"]); cfgDoc["auth_password"] = authPass; authChanged=true; }
-      if (allowSta  && in.containsKey("ssid")) { cfgDoc["wifi_sta_ssid"] = (const char*)in["ssid"]; }
-      if (allowSta  && in.containsKey("password")) { cfgDoc["wifi_sta_password"] = (const char*)in["password"]; }
-      if (allowApi  && in.containsKey("apiUrl")) { cfgDoc["api_url"] = (const char*)in["apiUrl"]; uploaderChanged=true; }
-      if (allowApi  && in.containsKey("intervalMs")) { cfgDoc["upload_interval"] = (uint32_t)in["intervalMs"]; uploaderChanged=true; }
-
-      // Detect AP changes (will not apply immediately to avoid dropping client connection)
-      if (allowAp){
-        String newApSsid = String((const char*)(cfgDoc["wifi_ap_ssid"] | ""));
-        String newApPass = String((const char*)(cfgDoc["wifi_ap_password"] | ""));
-        apChanged = (newApSsid != prevApSsid) || (newApPass != prevApPass);
-      }
-
-      { String tmp; serializeJson(cfgDoc, tmp); SDfs.writeAll(CFG_JSON, tmp); }
-      if (authChanged) saveAuthToFile();
-
-      if (uploaderChanged){
-        UploadCfg uc; uc.api = (const char*)(cfgDoc["api_url"] | ""); uc.interval_ms = (uint32_t)(cfgDoc["upload_interval"] | 0); uc.batch_size = 10; 
-        up_.set(uc);
-      }
+      auto str = [&](bool allow, const char* key, String& dst){
+        if (allow && !in[key].isNull()) dst = (const char*)(in[key] | "");
+      };
+      auto num = [&](bool allow, const char* key, uint32_t& dst){
+        if (allow && !in[key].isNull()) dst = (uint32_t)(in[key] | 0);
+      };
+      uint32_t changed = 0;
+      config_.update([&](AppConfig& c){
+        // New fields, then legacy keys (map to new), scoped by type
+        str(allowAuth, "auth_user",         c.auth_user);
+        str(allowAuth, "auth_password",     c.auth_password);
+        str(allowAp,   "wifi_ap_ssid",      c.wifi_ap_ssid);
+        str(allowAp,   "wifi_ap_password",  c.wifi_ap_password);
+        str(allowSta,  "wifi_sta_ssid",     c.wifi_sta_ssid);
+        str(allowSta,  "wifi_sta_password", c.wifi_sta_password);
+        str(allowApi,  "api_url",           c.api_url);
+        num(allowApi,  "upload_interval",   c.upload_interval);
+        str(allowAuth, "user",              c.auth_user);
+        str(allowAuth, "pass",              c.auth_password);
+        str(allowSta,  "ssid",              c.wifi_sta_ssid);
+        str(allowSta,  "password",          c.wifi_sta_password);
+        str(allowApi,  "apiUrl",            c.api_url);
+        num(allowApi,  "intervalMs",        c.upload_interval);
+      }, &changed);
+      // the uploader follows ChangedApi through its subscription (main.cpp)
 
       // Do NOT apply AP changes immediately; avoid disconnecting the client.
       // Frontend can prompt for manual reboot if desired.
 
       StaticJsonDocument<128> resp;
       resp["ok"] = true;
-      if (apChanged) resp["ap_change_pending"] = true;
-      if (uploaderChanged) resp["uploader_updated"] = true;
+      if (changed & ConfigService::ChangedAp)  resp["ap_change_pending"] = true;
+      if (changed & ConfigService::ChangedApi) resp["uploader_updated"] = true;
       sendJson(req,200,resp.as<JsonVariantConst>());
     }
   );
@@ -586,108 +1328,63 @@ bool HttpApi::begin(){
       if (v > 0 && v < 2000) limit = (size_t)v;
     }
 
-    // ---- helpers ----
-    auto basenameOf = [](const String& path)->String {
-      int p = path.lastIndexOf('/');
-      return (p >= 0) ? path.substring(p+1) : path;
-    };
-
-    // filename: LOG.<rfid>.<YYYYMMDDHHMMSS>.<scanner>[.N]
-    auto parseSpoolName = [](const String& base, String& rfid, String& ts14, String& scanner)->bool {
-      if (!base.startsWith("LOG.")) return false;
-
-      int d1 = base.indexOf('.', 4);            // after "LOG."
-      if (d1 < 0) return false;
-      int d2 = base.indexOf('.', d1 + 1);       // after ts14
-      if (d2 < 0) return false;
-
-      rfid = base.substring(4, d1);
-      ts14 = base.substring(d1 + 1, d2);
-
-      // scanner may have optional collision suffix ".N" -> strip it if present
-      int d3 = base.indexOf('.', d2 + 1);
-      scanner = (d3 < 0) ? base.substring(d2 + 1)
-                        : base.substring(d2 + 1, d3);
-
-      // validate pieces
-      if (rfid.isEmpty() || scanner.isEmpty()) return false;
-      if (ts14.length() != 14) return false;
-      for (size_t i=0;i<ts14.length();++i) {
-        if (ts14[i] < '0' || ts14[i] > '9') return false;
-      }
-      return true;
-    };
-
-    auto ts14ToIso = [](const String& ts14)->String {
-      // ts14 = YYYYMMDDHHMMSS
-      if (ts14.length() != 14) return String("");
-      String iso;
-      iso.reserve(19);
-      iso  = ts14.substring(0,4)  + "-"  // YYYY-
-          +  ts14.substring(4,6)  + "-"  // MM-
-          +  ts14.substring(6,8)  + " "  // DD␠
-          +  ts14.substring(8,10) + ":"  // HH:
-          +  ts14.substring(10,12)+ ":"  // MM:
-          +  ts14.substring(12,14);      // SS
-      return iso;
-    };
-
-    struct Item { String scanner; String rfid; String ts14; String fname; };
-
-    std::vector<Item> items;
-    items.reserve(limit ? limit : 64);
-
-    // ---- scan spool dir ----
-    const char* kSpoolDir = "/spool";
-    SDfs.lock();
-    File dir = SD.open(kSpoolDir);
-    if (!dir || !dir.isDirectory()) {
-      if (dir) dir.close();
-      SDfs.unlock();
-      sendJsonText(req, 200, "[]");
+    // Cached per spool generation: a poll that finds nothing new costs no
+    // SD access at all, identical concurrent polls share one scan, and the
+    // ETag lets a browser revalidate with a bodyless 304
+    const uint32_t gen = spool_generation();
+    const String etag = logsEtag(gen, limit);
+    const AsyncWebHeader* inm = req->getHeader("If-None-Match");
+    if (inm && inm->value() == etag) {
+      auto* resp = req->beginResponse(304);
+      resp->addHeader("ETag", etag);
+      resp->addHeader("Cache-Control", "no-cache");
+      req->send(resp);
       return;
     }
-
-    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
-      if (!f.isDirectory()) {
-        String base = basenameOf(f.name());
-        String rfid, ts14, scanner;
-        if (parseSpoolName(base, rfid, ts14, scanner)) {
-          items.push_back({scanner, rfid, ts14, base});
-        }
-      }
-      f.close();
-      // soft cap on scanning so we don't spend forever in a huge dir
-      if (items.size() >= (limit ? (limit * 8) : 800)) break;
+    xSemaphoreTake(s_logs_mtx, portMAX_DELAY);
+    if (s_logs_cache.list && s_logs_cache.gen == gen && s_logs_cache.limit == limit) {
+      SpoolList list = s_logs_cache.list;
+      xSemaphoreGive(s_logs_mtx);
+      sendLogs(req, list, etag);
+      return;
     }
-    dir.close();
-    SDfs.unlock();
-
-    // ---- sort newest -> oldest by timestamp (then scanner, then rfid) ----
-    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b){
-      int tc = a.ts14.compareTo(b.ts14);
-      if (tc != 0) return tc > 0; // newer first
-      int sc = a.scanner.compareTo(b.scanner);
-      if (sc != 0) return sc < 0;
-      return a.rfid.compareTo(b.rfid) < 0;
-    });
-
-    // ---- limit to requested count ----
-    if (items.size() > limit) items.resize(limit);
-
-    // ---- render JSON ----
-    StaticJsonDocument<16384> doc;
-    JsonArray arr = doc.to<JsonArray>();
-    for (const auto& it : items) {
-      JsonObject o = arr.createNestedObject();
-      o["scanner_id"] = it.scanner;
-      o["rfid"]       = it.rfid;
-      o["timestamp"]  = ts14ToIso(it.ts14);  // derived from filename
-      o["code"]       = 0;
-      o["msg"]        = "";
+    LogsFlight* fl = s_logs_flight;
+    if (fl && fl->gen == gen && fl->limit == limit) {
+      fl->waiters.push_back(req->pause());   // answered with the scan in progress
+      xSemaphoreGive(s_logs_mtx);
+      return;
+    }
+    fl = new LogsFlight{gen, limit, {}};
+    fl->waiters.push_back(req->pause());
+    s_logs_flight = fl;
+    xSemaphoreGive(s_logs_mtx);
+
+    // the directory walk runs on a job worker, not on async_tcp; the job
+    // answers no one itself, the flight answers every waiter
+    uint32_t id = submitJob("logs", [=](JobResult&){
+      // the listing is the only allocation that grows with limit: refuse
+      // up front rather than fail half way
+      if (ESP.getMaxAllocHeap() < (limit + 1) * sizeof(SpoolEntry) + kLogsHeapMargin) {
+        xSemaphoreTake(s_logs_mtx, portMAX_DELAY);
+        finishLogsFlight(fl, nullptr, String(), 507, "insufficient_memory");
+        return;
+      }
+      auto list = std::make_shared<std::vector<SpoolEntry>>();
+      spoolNewest(limit, *list);
+      xSemaphoreTake(s_logs_mtx, portMAX_DELAY);
+      if (list->size() <= kLogsCacheRows) {
+        s_logs_cache.gen   = gen;
+        s_logs_cache.limit = limit;
+        s_logs_cache.list  = list;
+      } else {
+        s_logs_cache = LogsCache();
+      }
+      finishLogsFlight(fl, list, etag);
+    }, AsyncWebServerRequestPtr());
+    if (!id) {
+      xSemaphoreTake(s_logs_mtx, portMAX_DELAY);
+      finishLogsFlight(fl, nullptr, String(), 503, "busy");
     }
-    String out; serializeJson(arr, out);
-    sendJsonText(req, 200, out);
   });
 
   // POST /api/logs/reset
@@ -699,110 +1396,144 @@ bool HttpApi::begin(){
       return;
     }
 
-    const char* kSpoolDir = "/spool";
-    const char* kCursor   = "/upload.cursor";
+    deferToJob(req, "logs_reset", [](JobResult& res){
+      const char* kSpoolDir = "/spool";
+      const char* kCursor   = "/upload.cursor";
 
-    size_t removed = 0;
-    uint64_t bytesFreed = 0;
-    bool cursorDeleted = false;
+      size_t removed = 0;
+      uint64_t bytesFreed = 0;
+      bool cursorDeleted = false;
 
-    SDfs.lock();
+      SDfs.lock();
 
-    if (!SDfs.isMounted()) {
-      SDfs.unlock();
-      sendJsonText(req, 500, "{\"error\":\"sd_not_mounted\"}");
-      return;
-    }
+      if (!SDfs.isMounted()) {
+        SDfs.unlock();
+        res.code = 500;
+        res.body = "{\"error\":\"sd_not_mounted\"}";
+        return;
+      }
 
-    // Open spool dir (create if missing to keep system consistent)
-    File dir = SD.open(kSpoolDir);
-    if (!dir) {
-      // No dir yet -> just ensure it exists after this call
-      SD.mkdir(kSpoolDir);
-    } else if (!dir.isDirectory()) {
-      // Something odd is at /spool; try to clean and recreate
-      dir.close();
-      (void)SD.remove(kSpoolDir);
-      SD.mkdir(kSpoolDir);
-    } else {
-      // Iterate and delete files inside /spool
-      for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
-        if (f.isDirectory()) { f.close(); continue; }
-        // capture info before close
-        String name = f.name();        // may be "spool/..." or "/spool/..."
-        uint64_t sz = f.size();
-        f.close();
-
-        // Build absolute path if needed
-        String full = name;
-        if (!full.startsWith("/")) full = String(kSpoolDir) + "/" + full;
-
-        if (SD.remove(full)) {
-          removed++;
-          bytesFreed += sz;
+      // Open spool dir (create if missing to keep system consistent)
+      File dir = SD.open(kSpoolDir);
+      if (!dir) {
+        // No dir yet -> just ensure it exists after this call
+        SD.mkdir(kSpoolDir);
+      } else if (!dir.isDirectory()) {
+        // Something odd is at /spool; try to clean and recreate
+        dir.close();
+        (void)SD.remove(kSpoolDir);
+        SD.mkdir(kSpoolDir);
+      } else {
+        // Iterate and delete files inside /spool
+        for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+          if (f.isDirectory()) { f.close(); continue; }
+          // capture info before close
+          String name = f.name();        // may be "spool/..." or "/spool/..."
+          uint64_t sz = f.size();
+          f.close();
+
+          // Build absolute path if needed
+          String full = name;
+          if (!full.startsWith("/")) full = String(kSpoolDir) + "/" + full;
+
+          if (SD.remove(full)) {
+            removed++;
+            bytesFreed += sz;
+            spool_touch();
+          }
+          // others may have added or removed files meanwhile: start over,
+          // which only finds what is left
+          if (SDfs.yield()) dir.rewindDirectory();
         }
+        dir.close();
       }
-      dir.close();
-    }
 
-    // Make sure /spool exists after reset
-    SD.mkdir(kSpoolDir);
+      // Make sure /spool exists after reset
+      SD.mkdir(kSpoolDir);
 
-    // Remove legacy cursor file (safe even if unused in spool-mode)
-    cursorDeleted = SD.remove(kCursor);
+      // Remove legacy cursor file (safe even if unused in spool-mode)
+      cursorDeleted = SD.remove(kCursor);
 
-    SDfs.unlock();
+      SDfs.unlock();
+      spool_touch();
+
+      // Response
+      JsonDocument d;
+      d["ok"]             = true;
+      d["spool_cleared"]  = removed;                  // number of files deleted
+      d["bytes_freed"]    = (uint32_t)bytesFreed;     // truncated to 32-bit for payload
+      d["cursor_deleted"] = cursorDeleted;
+      serializeJson(d, res.body);
+    });
+  });
 
-    // Response
-    StaticJsonDocument<256> d;
-    d["ok"]             = true;
-    d["spool_cleared"]  = removed;                  // number of files deleted
-    d["bytes_freed"]    = (uint32_t)bytesFreed;     // truncated to 32-bit for payload
-    d["cursor_deleted"] = cursorDeleted;
+  // GET /api/export?from=&to=&scanner=&format=ndjson|csv
+  // Spooled records in [from, to] (any of YYYY-MM-DD[ HH:MM:SS] or 14
+  // digits; both optional), optionally for one scanner, streamed.
+  server.on("/api/export", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
+    if (!(isLoggedIn || hasSession(req))) { sendJsonText(req, 401, "{\"error\":\"unauthorized\"}"); return; }
+    if (!SDfs.isMounted()) { sendJsonText(req, 503, "{\"error\":\"sd_not_mounted\"}"); return; }
+    String format = req->hasParam("format") ? req->getParam("format")->value() : String("ndjson");
+    if (format != "ndjson" && format != "csv") { sendJsonText(req, 400, "{\"error\":\"invalid_format\"}"); return; }
+
+    auto st = std::make_shared<ExportStream>();
+    st->csv = (format == "csv");
+    exportBound(req->hasParam("from") ? req->getParam("from")->value() : String(), '0', st->from);
+    exportBound(req->hasParam("to")   ? req->getParam("to")->value()   : String(), '9', st->to);
+    if (req->hasParam("scanner")) st->scanner = req->getParam("scanner")->value();
+    {
+      auto uc = up_.cfg();
+      st->dirs[0] = uc->spool_dir.length() ? uc->spool_dir : String("/spool");
+      st->dirs[1] = uc->dead_dir.length()  ? uc->dead_dir  : String("/spool_dead");
+    }
+    st->t0 = millis();
+
+    auto* resp = req->beginChunkedResponse(st->csv ? "text/csv; charset=utf-8" : "application/x-ndjson",
+      [st](uint8_t* out, size_t maxLen, size_t) -> size_t {
+        size_t w = 0;
+        while (w < maxLen) {
+          if (st->roff == st->rlen && !st->fill()) break;
+          size_t n = st->rlen - st->roff;
+          if (n > maxLen - w) n = maxLen - w;
+          memcpy(out + w, st->row + st->roff, n);
+          st->roff += n; w += n;
+        }
+        st->bytes += w;
+        return w;
+      });
+    resp->addHeader("Cache-Control", "no-store");
+    resp->addHeader("Content-Disposition", st->csv ? "attachment; filename=\"export.csv\""
+                                                   : "attachment; filename=\"export.ndjson\"");
+    req->send(resp);
+  });
 
-    String out; serializeJson(d, out);
-    sendJsonText(req, 200, out);
+  // GET /api/dashboard: status, last upload, Wi-Fi and recent scans in one
+  // body, from the snapshot feedTask keeps current (see dashPublish)
+  server.on("/api/dashboard", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
+    if (!(isLoggedIn || hasSession(req))) { sendJsonText(req, 401, "{\"error\":\"unauthorized\"}"); return; }
+    xSemaphoreTake(s_dash_mtx, portMAX_DELAY);
+    SharedBody body = s_dash_body;
+    uint32_t   ver  = s_dash_ver;
+    xSemaphoreGive(s_dash_mtx);
+    if (!body) { sendJsonText(req, 503, "{\"error\":\"starting\"}"); return; }
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08x-d%x\"", (unsigned)s_boot_tag, (unsigned)ver);
+    const AsyncWebHeader* inm = req->getHeader("If-None-Match");
+    if (inm && inm->value() == etag) {
+      auto* resp = req->beginResponse(304);
+      resp->addHeader("ETag", etag);
+      resp->addHeader("Cache-Control", "no-cache");
+      req->send(resp);
+      return;
+    }
+    sendShared(req, 200, body, etag);
   });
 
   // === Uploader controls ===
   server.on("/api/upload/status", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
     if (!(isLoggedIn || hasSession(req))) { req->send(401, "application/json", "{\"error\":\"unauthorized\"}"); return; }
-    StaticJsonDocument<256> d;
-    d["enabled"] = up_.isEnabled();
-
-    // Prefer in-memory cfg; if missing, lazily hydrate from SD:/config.json
-    String api_url = String(up_.cfg().api.c_str());
-    uint32_t interval_ms = (uint32_t)up_.cfg().interval_ms;
-    if (api_url.length()==0 || interval_ms==0){
-      String raw; StaticJsonDocument<512> cfg;
-      if (SDfs.readAll("/config.json", raw) && !deserializeJson(cfg, raw)){
-        String sd_api = String((const char*)(cfg["api_url"] | cfg["apiUrl"] | ""));
-        uint32_t sd_int = (uint32_t)(cfg["upload_interval"] | cfg["intervalMs"] | 0);
-        if (api_url.length()==0) api_url = sd_api;
-        if (interval_ms==0) interval_ms = sd_int;
-        // Keep uploader in sync for subsequent operations
-        if (api_url.length() || interval_ms){ UploadCfg uc = up_.cfg(); uc.api = api_url.c_str(); uc.interval_ms = interval_ms; up_.set(uc); }
-      }
-    }
-
-    d["api_url"] = api_url;
-    d["interval_ms"] = interval_ms;
-    bool sta_connected = (WiFi.status() == WL_CONNECTED);
-    d["sta_connected"] = sta_connected;
-
-    bool valid = (api_url.length() > 0 && interval_ms > 1000 && sta_connected);
-    if (valid){
-      String api = api_url; api.toLowerCase();
-      if (api.indexOf("localhost")>=0 || api.indexOf("127.0.0.1")>=0){ valid = false; d["reason"] = "api_url_localhost_unreachable_from_device"; }
-    }
-    if (!valid){
-      if (!d.containsKey("reason")){
-        if (api_url.length()==0) d["reason"] = "missing_api_url";
-        else if (interval_ms <= 1000) d["reason"] = "interval_too_low";
-        else if (!sta_connected) d["reason"] = "sta_not_connected";
-      }
-    }
-    d["valid"] = valid;
+    JsonDocument d;
+    uploadStatusJson(up_, config_, d);
     sendJson(req,200,d.as<JsonVariantConst>());
   });
 
@@ -813,18 +1544,12 @@ bool HttpApi::begin(){
       return;
     }
 
-    // ---- Build effective config from stored /config.json if fields are missing
-    UploadCfg uc = up_.cfg();
+    // ---- Build effective config from the saved config if fields are missing
+    UploadCfg uc = *up_.cfg();
     if (uc.api.empty() || uc.interval_ms == 0){
-      String raw;
-      JsonDocument cfg;
-      if (SDfs.readAll("/config.json", raw) == true && !deserializeJson(cfg, raw)) {
-        if (uc.api.empty()) {
-          uc.api = (const char*)(cfg["api_url"] | cfg["apiUrl"] | "");
-        }
-        uint32_t iv = (uint32_t)(cfg["upload_interval"] | cfg["intervalMs"] | 0);
-        if (iv) uc.interval_ms = iv;
-      }
+      auto c = config_.get();
+      if (uc.api.empty()) uc.api = c->api_url.c_str();
+      if (c->upload_interval) uc.interval_ms = c->upload_interval;
     }
 
     // ---- Spool is the default source
@@ -846,10 +1571,37 @@ bool HttpApi::begin(){
       long v = req->getParam("batch")->value().toInt();
       if (v > 0 && v <= 500) uc.batch_size = (size_t)v;
     }
+    if (req->hasParam("adaptive")) {
+      // adaptive=0 keeps batch at exactly `batch` items
+      uc.adaptive_batch = req->getParam("adaptive")->value() != "0";
+    }
     if (req->hasParam("intervalMs")) {
       long v = req->getParam("intervalMs")->value().toInt();
       if (v >= 1000) uc.interval_ms = (uint32_t)v;
     }
+    if (req->hasParam("pipeline")) {
+      // pipeline=0 runs the stages strictly one after another (A/B throughput)
+      uc.pipeline = req->getParam("pipeline")->value() != "0";
+    }
+    if (req->hasParam("window")) {
+      // batches in flight on MQTT endpoints (mqtt://host/topic)
+      long v = req->getParam("window")->value().toInt();
+      if (v >= 1 && v <= 8) uc.window = (uint8_t)v;
+    }
+    if (req->hasParam("workers")) {
+      // parallel catch-up connections while draining a backlog (1 = off)
+      long v = req->getParam("workers")->value().toInt();
+      if (v >= 1 && v <= 4) uc.workers = (uint8_t)v;
+    }
+    if (req->hasParam("item_ids")) {
+      // 1 -> every record carries an "id" and per-item acks are honoured
+      uc.item_ids = req->getParam("item_ids")->value() == "1";
+    }
+    if (req->hasParam("format")) {
+      // "msgpack" -> binary body (epoch ts, raw UID); anything else -> JSON
+      uc.format = req->getParam("format")->value().equalsIgnoreCase("msgpack")
+                    ? UploadFormat::MsgPack : UploadFormat::Json;
+    }
 
     // ---- Validate
     if (uc.api.empty()){ req->send(400, "application/json", "{\"error\":\"missing_api_url\"}"); return; }
@@ -878,13 +1630,12 @@ bool HttpApi::begin(){
 
     // ---- Respond immediately (do not block HTTP task)
     {
-      StaticJsonDocument<256> resp;
+      JsonDocument resp;
       resp["ok"] = true;
       resp["started"] = true;
       resp["mode"] = uc.use_sd_spool ? "spool" : "repo";
       resp["spool_dir"] = uc.use_sd_spool ? uc.spool_dir : "";
-      String out; serializeJson(resp, out);
-      req->send(202, "application/json", out);
+      sendJson(req, 202, resp.as<JsonVariantConst>());
     }
 
     // ---- Kick the worker
@@ -909,8 +1660,9 @@ bool HttpApi::begin(){
   // Debug: last upload attempt summary
   server.on("/api/upload/last", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
     if (!(isLoggedIn || hasSession(req))) { req->send(401, "application/json", "{\"error\":\"unauthorized\"}"); return; }
-    const auto& d = up_.debug();
-    StaticJsonDocument<256> j;
+    auto snap = up_.debug();                 // one consistent version
+    const UploaderService::UploadDebug& d = *snap;
+    JsonDocument j;
     j["last_ms"] = d.last_ms;
     j["code"] = d.code;
     j["success"] = d.success;
@@ -921,9 +1673,72 @@ bool HttpApi::begin(){
     j["scanner"] = d.scanner.c_str();
     j["items"] = (uint32_t)d.items;
     j["payload"] = d.array_body ? "array" : "object";
+    j["backlog"] = (uint32_t)d.backlog;
+    j["draining"] = d.draining;
+    j["drain_rate"] = d.drain_rate;          // items/s
+    j["next_in_ms"] = d.next_in_ms;
+    j["pipeline"] = d.pipeline;
+    j["sd_ms"] = d.sd_ms;
+    j["net_ms"] = d.net_ms;
+    j["ack_ms"] = d.ack_ms;
+    j["item_ack"] = d.item_ack;
+    j["accepted"] = (uint32_t)d.accepted;
+    j["rejected"] = (uint32_t)d.rejected;
+    j["dead_total"] = d.dead_total;
+    j["format"] = d.format;
+    j["bytes_per_item"] = d.bytes_per_item;
+    j["encode_us"] = d.encode_us;
+    j["in_flight"] = (uint32_t)d.in_flight;
+    j["workers"] = d.workers;
+    j["batch_target"] = (uint32_t)d.batch_target;
+    j["batch_limit"] = (uint32_t)d.batch_limit;
+    j["rtt_ms"] = d.rtt_ms;
+    j["dns"] = d.timing.dns;
+    j["resolve_ms"] = d.timing.resolve_ms;
+    j["connect_ms"] = d.timing.connect_ms;
+    j["request_ms"] = d.timing.request_ms;
     sendJson(req,200,j.as<JsonVariantConst>());
   });
 
+  // Per-scanner backlog: pending count and age of the oldest record, so the
+  // fair scheduler's bounded-delay guarantee can be checked from outside.
+  server.on("/api/upload/scanners", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
+    if (!(isLoggedIn || hasSession(req))) { req->send(401, "application/json", "{\"error\":\"unauthorized\"}"); return; }
+    auto stats = up_.scannerStats();
+    JsonDocument j;
+    JsonArray arr = j["scanners"].to<JsonArray>();
+    int32_t maxAge = -1;
+    for (const auto& st : stats){
+      JsonObject o = arr.add<JsonObject>();
+      o["scanner"]        = st.scanner;
+      o["pending"]        = (uint32_t)st.pending;
+      o["oldest_ts"]      = st.oldest_ts;
+      o["oldest_age_s"]   = st.oldest_age_s;
+      o["last_served_ms"] = st.last_served_ms;
+      o["batches"]        = st.batches;
+      if (st.oldest_age_s > maxAge) maxAge = st.oldest_age_s;
+    }
+    j["max_oldest_age_s"] = maxAge;
+    sendJson(req,200,j.as<JsonVariantConst>());
+  });
+
+  // Prometheus scrape target. Scrapers cannot log in through the UI, so
+  // HTTP Basic with the portal credentials is accepted as well.
+  server.on("/api/metrics", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
+    bool ok = isLoggedIn || hasSession(req);
+    if (!ok) {
+      auto c = config_.get();
+      ok = req->authenticate(c->auth_user.c_str(), c->auth_password.c_str());
+    }
+    if (!ok) { req->requestAuthentication(); return; }
+    String out;
+    out.reserve(4096);
+    metrics::render(out);
+    auto* resp = req->beginResponse(200, "text/plain; version=0.0.4; charset=utf-8", out);
+    resp->addHeader("Cache-Control", "no-store");
+    req->send(resp);
+  });
+
   // Health
   server.on("/ping", HTTP_GET, [](AsyncWebServerRequest* r){ r->send(200, "text/plain", "pong"); });
   // Quick check route that does not depend on FS/auth
@@ -960,17 +1775,15 @@ bool HttpApi::begin(){
 
   server.on("/api/sd/list", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
     if (!(isLoggedIn || hasSession(req))) { req->send(401, "application/json", "{\"error\":\"unauthorized\"}"); return; }
-    SDfs.lock();
-    bool mounted = SDfs.isMounted();
     String path = "/";
     if (req->hasParam("path")) { path = req->getParam("path")->value(); }
     if (!path.length()) path = "/";
     if (path[0] != '/') path = String("/") + path;
 
-    if (!mounted){
-      String out = "{\"mounted\":false,\"path\":\"" + path + "\",\"items\":[]}";
+    SDfs.lock();
+    if (!SDfs.isMounted()){
       SDfs.unlock();
-      req->send(200, "application/json", out);
+      sendJsonText(req, 200, "{\"mounted\":false,\"path\":" + jsonQuote(path) + ",\"items\":[]}");
       return;
     }
 
@@ -984,77 +1797,40 @@ bool HttpApi::begin(){
       }
     }
     if (!f){
-      String out = "{\"mounted\":true,\"path\":\"" + path + "\",\"error\":\"open_failed\"}";
       SDfs.unlock();
-      req->send(404, "application/json", out);
+      sendJsonText(req, 404, "{\"mounted\":true,\"path\":" + jsonQuote(path) + ",\"error\":\"open_failed\"}");
       return;
     }
 
-    String out;
-    out.reserve(1024);
     if (!f.isDirectory()){
-      // By default, do NOT stream the whole file to avoid long blocking.
-      // Return metadata unless raw=1 is explicitly requested.
-      bool wantRaw = req->hasParam("raw");
-      if (!wantRaw){
-        uint32_t sz = (uint32_t)f.size();
-        f.close(); SDfs.unlock();
-        out = "{\"mounted\":true,\"path\":\"" + path + "\",\"isFile\":true,\"size\":" + String(sz) + "}";
-        req->send(200, "application/json", out);
-        return;
-      }
-      // raw content with limits and cooperative yields
-      String lower = path; lower.toLowerCase();
-      String ctype = "application/octet-stream";
-      if (lower.endsWith(".json")) ctype = "application/json";
-      else if (lower.endsWith(".csv")) ctype = "text/csv";
-      else if (lower.endsWith(".txt")) ctype = "text/plain";
-
-      size_t maxBytes = 65536; // 64KB cap by default
-      if (req->hasParam("max")){
-        maxBytes = (size_t) strtoul(req->getParam("max")->value().c_str(), nullptr, 10);
-        if (maxBytes < 1024) maxBytes = 1024; if (maxBytes > 200000) maxBytes = 200000;
-      }
-      String content; content.reserve(4096);
-      size_t readBytes = 0; uint32_t iter = 0;
-      while (f.available() && readBytes < maxBytes){
-        char buf[512];
-        size_t n = f.readBytes(buf, sizeof(buf));
-        if (!n) break;
-        if (readBytes + n > maxBytes) n = maxBytes - readBytes;
-        content.concat(String(buf).substring(0, n));
-        readBytes += n;
-        if ((++iter % 8) == 0) { delay(0); }
-      }
+      uint32_t sz = (uint32_t)f.size();
       f.close(); SDfs.unlock();
-      auto* resp = req->beginResponse(200, ctype, content);
-      resp->addHeader("Cache-Control", "no-store");
-      req->send(resp);
+      // raw=1: the content, streamed (Range-capable); else metadata only
+      if (req->hasParam("raw")) { sendFileStream(req, true, path, guessMime(path), false); return; }
+      sendJsonText(req, 200, "{\"mounted\":true,\"path\":" + jsonQuote(path) + ",\"isFile\":true,\"size\":" + String(sz) + "}");
       return;
     }
+    SDfs.unlock();
 
-    out = "{\"mounted\":true,\"path\":\"" + path + "\",\"items\":[";
-    uint32_t count = 0;
-    uint32_t iter = 0;
-    for (File e = f.openNextFile(); e; e = f.openNextFile()){
-      if (count++) out += ",";
-      out += "{\"name\":\"";
-      out += String(e.name());
-      out += "\",\"dir\":";
-      out += e.isDirectory()? "true" : "false";
-      out += ",\"size\":";
-      out += String((uint32_t)e.size());
-      out += "}";
-      e.close();
-      if ((++iter % 16) == 0) { delay(0); }
-      if (count >= 500) break; // prevent overly large payloads
-    }
-    f.close(); SDfs.unlock();
-    out += "]}";
-    req->send(200, "application/json", out);
+    // One entry per step, the SD lock held only while reading it
+    sendJsonArray(req, "{\"mounted\":true,\"path\":" + jsonQuote(path) + ",\"items\":", "}",
+      [f](size_t i, JsonDocument& o) mutable {
+        if (i >= 500) return false;           // prevent overly large listings
+        SDfs.lock();
+        File e = f.openNextFile();
+        bool got = (bool)e;
+        if (got) {
+          o["name"] = e.name();
+          o["dir"]  = e.isDirectory();
+          o["size"] = (uint32_t)e.size();
+          e.close();
+        }
+        SDfs.unlock();
+        return got;
+      },
+      [f]() mutable { SDfs.lock(); f.close(); SDfs.unlock(); });
   });
 
-  
   // GET /api/file?fs=sd|lfs&path=/file&dl=1
   server.on("/api/file", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
     if (!(isLoggedIn || hasSession(req))) {
@@ -1072,37 +1848,13 @@ bool HttpApi::begin(){
     if (!path.startsWith("/")) path = "/" + path;
     if (path.indexOf("..") >= 0) { sendJsonText(req, 400, "{\"error\":\"invalid_path\"}"); return; }
 
-    String data;
-    bool ok = false;
-
     // Default to SD; allow explicit "lfs" / "littlefs"
-    if (fs.equalsIgnoreCase("sd")) {
-      ok = SDfs.readAll(path.c_str(), data);
-    } else if (fs.equalsIgnoreCase("lfs") || fs.equalsIgnoreCase("littlefs")) {
-      ok = readAllFileFS(path.c_str(), data);
-    } else {
+    bool sd = fs.equalsIgnoreCase("sd");
+    if (!sd && !fs.equalsIgnoreCase("lfs") && !fs.equalsIgnoreCase("littlefs")) {
       sendJsonText(req, 400, "{\"error\":\"invalid_fs\"}");
       return;
     }
-
-    if (!ok) {
-      // Not found or failed to read
-      sendJsonText(req, 404, "{\"error\":\"open_failed\"}");
-      return;
-    }
-
-    const char* mime = guessMime(path);
-
-    // Stream back the file content
-    auto* resp = req->beginResponse(200, mime, data);
-    resp->addHeader("Cache-Control", "no-store");
-    if (dl) {
-      // Force download if requested
-      String fname = path.substring(path.lastIndexOf('/') + 1);
-      if (!fname.length()) fname = "download.bin";
-      resp->addHeader("Content-Disposition", String("attachment; filename=\"") + fname + "\"");
-    }
-    req->send(resp);
+    sendFileStream(req, sd, path, guessMime(path), dl);
   });
 
   // Captive portal helpers for Android/iOS/Windows
@@ -1110,165 +1862,47 @@ bool HttpApi::begin(){
   server.on("/hotspot-detect.html", HTTP_GET, [](AsyncWebServerRequest* r){ r->send(200, "text/html", "<html><body>OK</body></html>"); });
   server.on("/ncsi.txt", HTTP_GET, [](AsyncWebServerRequest* r){ r->send(200, "text/plain", "Microsoft NCSI"); });
 
-  // Static routes for frontend
-  // Determine LittleFS availability for static assets
+  // Static routes for frontend (embedded; LittleFS not involved)
   if (!g_lfs_mutex) g_lfs_mutex = xSemaphoreCreateMutex();
-  bool lfs_root_ok = false, lfs_js_ok = false, lfs_css_ok = false;
   {
-    lfs_lock();
-    File rtest = LittleFS.open("/", "r");
-    if (rtest){ lfs_root_ok = true; rtest.close(); }
-    File j = LittleFS.open("/js", "r"); if (j){ lfs_js_ok = j.isDirectory(); j.close(); }
-    File c = LittleFS.open("/css", "r"); if (c){ lfs_css_ok = c.isDirectory(); c.close(); }
-    lfs_unlock();
-  }
-
-  // Preload small UI assets into RAM to improve reliability/perf
-  if (lfs_root_ok){
-    readAllFileFS("/index.html", s_index_html);
-    readAllFileFS("/login.html", s_login_html);
-    readAllFileFS("/configuration.html", s_configuration_html);
-  }
-  if (lfs_css_ok){ readAllFileFS("/css/styles.css", s_styles_css); }
-  if (lfs_js_ok){
-    readAllFileFS("/js/app.js", s_app_js);
-    readAllFileFS("/js/login.js", s_login_js);
-    readAllFileFS("/js/configuration.js", s_configuration_js);
+    size_t bytes = 0;
+    for (size_t i = 0; i < kUiAssetCount; ++i) bytes += kUiAssets[i].len;
+    Serial.printf("[HTTP] UI: %u embedded assets, %u bytes in flash\n", (unsigned)kUiAssetCount, (unsigned)bytes);
   }
-
-  if (lfs_root_ok){
+  {
     auto sendInline = [](AsyncWebServerRequest* r, const char* body){
       auto* resp = r->beginResponse(200, "text/html", body);
       resp->addHeader("Cache-Control", "no-store");
       r->send(resp);
     };
-    server.on("/", HTTP_GET, [=](AsyncWebServerRequest* r){
-      if (!s_index_html.length()){
-        String tmp; if (readAllFileFS("/index.html", tmp)) s_index_html = tmp;
-      }
-      if (s_index_html.length()){
-        auto* resp = r->beginResponse(200, "text/html", s_index_html);
-        resp->addHeader("Cache-Control", "no-store");
-        resp->addHeader("Connection", "close");
-        r->send(resp); return;
-      }
-      sendInline(r, "<html><body>UI missing: index.html</body></html>");
-    });
-    server.on("/index.html", HTTP_GET, [=](AsyncWebServerRequest* r){
-      if (!s_index_html.length()){
-        String tmp; if (readAllFileFS("/index.html", tmp)) s_index_html = tmp;
-      }
-      if (s_index_html.length()){
-        auto* resp = r->beginResponse(200, "text/html", s_index_html);
-        resp->addHeader("Cache-Control", "no-store");
-        resp->addHeader("Connection", "close");
-        r->send(resp); return;
-      }
-      sendInline(r, "<html><body>UI missing: index.html</body></html>");
-    });
-    server.on("/login", HTTP_GET, [=](AsyncWebServerRequest* r){
-      if (!s_login_html.length()){
-        String tmp; if (readAllFileFS("/login.html", tmp)) s_login_html = tmp;
-      }
-      if (s_login_html.length()){
-        auto* resp = r->beginResponse(200, "text/html", s_login_html);
-        resp->addHeader("Cache-Control", "no-store");
-        resp->addHeader("Connection", "close");
-        r->send(resp); return;
-      }
-      sendInline(r, "<html><body>UI missing: login.html</body></html>");
-    });
-    server.on("/login.html", HTTP_GET, [=](AsyncWebServerRequest* r){
-      if (!s_login_html.length()){
-        String tmp; if (readAllFileFS("/login.html", tmp)) s_login_html = tmp;
-      }
-      if (s_login_html.length()){
-        auto* resp = r->beginResponse(200, "text/html", s_login_html);
-        resp->addHeader("Cache-Control", "no-store");
-        resp->addHeader("Connection", "close");
-        r->send(resp); return;
-      }
-      sendInline(r, "<html><body>UI missing: login.html</body></html>");
-    });
-    server.on("/configuration", HTTP_GET, [=](AsyncWebServerRequest* r){
-      if (!s_configuration_html.length()){
-        String tmp; if (readAllFileFS("/configuration.html", tmp)) s_configuration_html = tmp;
-      }
-      if (s_configuration_html.length()){
-        auto* resp = r->beginResponse(200, "text/html", s_configuration_html);
-        resp->addHeader("Cache-Control", "no-store");
-        resp->addHeader("Connection", "close");
-        r->send(resp); return;
-      }
-      sendInline(r, "<html><body>UI missing: configuration.html</body></html>");
-    });
-    server.on("/configuration.html", HTTP_GET, [=](AsyncWebServerRequest* r){
-      if (!s_configuration_html.length()){
-        String tmp; if (readAllFileFS("/configuration.html", tmp)) s_configuration_html = tmp;
-      }
-      if (s_configuration_html.length()){
-        auto* resp = r->beginResponse(200, "text/html", s_configuration_html);
-        resp->addHeader("Cache-Control", "no-store");
-        resp->addHeader("Connection", "close");
-        r->send(resp); return;
-      }
-      sendInline(r, "<html><body>UI missing: configuration.html</body></html>");
-    });
-
-    // Explicit key assets (avoid catch-all/static directory handlers)
-    if (lfs_css_ok){
-      server.on("/css/styles.css", HTTP_GET, [=](AsyncWebServerRequest* r){
-        if (!s_styles_css.length()){
-          String tmp; if (readAllFileFS("/css/styles.css", tmp)) s_styles_css = tmp;
-        }
-        if (s_styles_css.length()){
-          auto* resp = r->beginResponse(200, "text/css", s_styles_css);
-          resp->addHeader("Cache-Control", "no-store");
-          resp->addHeader("Connection", "close");
-          r->send(resp); return;
-        }
-        r->send(404, "text/plain", "styles.css not found");
+    struct Page { const char* url; const char* file; };
+    static const Page pages[] = {
+      { "/", "/index.html" },                 { "/index.html", "/index.html" },
+      { "/login", "/login.html" },            { "/login.html", "/login.html" },
+      { "/configuration", "/configuration.html" }, { "/configuration.html", "/configuration.html" },
+    };
+    for (const auto& p : pages) {
+      const char* file = p.file;
+      server.on(p.url, HTTP_GET, [=](AsyncWebServerRequest* r){
+        if (serveAsset(r, file)) return;
+        String msg = String("<html><body>UI missing: ") + (file + 1) + "</body></html>";
+        sendInline(r, msg.c_str());
       });
     }
-    if (lfs_js_ok){
-      server.on("/js/app.js", HTTP_GET, [=](AsyncWebServerRequest* r){
-        if (!s_app_js.length()){
-          String tmp; if (readAllFileFS("/js/app.js", tmp)) s_app_js = tmp;
-        }
-        if (s_app_js.length()){
-          auto* resp = r->beginResponse(200, "application/javascript", s_app_js);
-          resp->addHeader("Cache-Control", "no-store");
-          resp->addHeader("Connection", "close");
-          r->send(resp); return;
-        }
-        r->send(404, "text/plain", "app.js not found");
-      });
-      server.on("/js/login.js", HTTP_GET, [=](AsyncWebServerRequest* r){
-        if (!s_login_js.length()){
-          String tmp; if (readAllFileFS("/js/login.js", tmp)) s_login_js = tmp;
-        }
-        if (s_login_js.length()){
-          auto* resp = r->beginResponse(200, "application/javascript", s_login_js);
-          resp->addHeader("Cache-Control", "no-store");
-          resp->addHeader("Connection", "close");
-          r->send(resp); return;
-        }
-        r->send(404, "text/plain", "login.js not found");
-      });
+
+    // Explicit key assets (avoid catch-all/static directory handlers)
+    for (size_t i = 0; i < kUiAssetCount; ++i) {
+      const char* file = kUiAssets[i].path;
+      if (strncmp(file, "/css/", 5) && strncmp(file, "/js/", 4)) continue;
+      server.on(file, HTTP_GET, [=](AsyncWebServerRequest* r){ serveAsset(r, file); });
     }
-  } else {
-    // Minimal inline pages to avoid touching LittleFS when not present
-    auto sendInline = [](AsyncWebServerRequest* r, const char* body){
-      auto* resp = r->beginResponse(200, "text/html", body);
-      resp->addHeader("Cache-Control", "no-store");
-      r->send(resp);
-    };
-    server.on("/", HTTP_GET, [=](AsyncWebServerRequest* r){ sendInline(r, "<html><body><h3>UI not installed</h3><p>Please upload LittleFS data.</p></body></html>"); });
-    server.on("/index.html", HTTP_GET, [=](AsyncWebServerRequest* r){ sendInline(r, "<html><body>UI missing</body></html>"); });
-    server.on("/login", HTTP_GET, [=](AsyncWebServerRequest* r){ sendInline(r, "<html><body>UI missing</body></html>"); });
-    server.on("/login.html", HTTP_GET, [=](AsyncWebServerRequest* r){ sendInline(r, "<html><body>UI missing</body></html>"); });
-    server.on("/configuration", HTTP_GET, [=](AsyncWebServerRequest* r){ sendInline(r, "<html><body>UI missing</body></html>"); });
-    server.on("/configuration.html", HTTP_GET, [=](AsyncWebServerRequest* r){ sendInline(r, "<html><body>UI missing</body></html>"); });
+  }
+  bool lfs_root_ok = false;
+  {
+    lfs_lock();
+    File rtest = LittleFS.open("/", "r");
+    if (rtest){ lfs_root_ok = true; rtest.close(); }
+    lfs_unlock();
   }
   if (lfs_root_ok && LittleFS.exists("/favicon.ico")){
     server.serveStatic("/favicon.ico", LittleFS, "/favicon.ico").setCacheControl("no-store");
@@ -1283,20 +1917,6 @@ bool HttpApi::begin(){
   // We already serve explicit pages (/, /index.html, /login, /configuration)
   // above, and static assets from /css and /js.
 
-  // Explicit static route for configuration.js
-  server.on("/js/configuration.js", HTTP_GET, [=](AsyncWebServerRequest* r){
-    if (!s_configuration_js.length()){
-      String tmp; if (readAllFileFS("/js/configuration.js", tmp)) s_configuration_js = tmp;
-    }
-    if (s_configuration_js.length()){
-      auto* resp = r->beginResponse(200, "application/javascript", s_configuration_js);
-      resp->addHeader("Cache-Control", "no-store");
-      resp->addHeader("Connection", "close");
-      r->send(resp); return;
-    }
-    r->send(404, "text/plain", "configuration.js not found");
-  });
-
   // LittleFS debug listing (optional): /api/fs/list?path=/js
   server.on("/api/fs/list", HTTP_GET, [](AsyncWebServerRequest* req){
     String path = "/";
@@ -1329,22 +1949,23 @@ bool HttpApi::begin(){
       return;
     }
 
-    AsyncResponseStream* res = req->beginResponseStream("application/json");
-    res->addHeader("Cache-Control", "no-store");
-    res->print("{\"path\":\""); res->print(path); res->print("\",\"items\":[");
-    uint32_t count = 0;
-    for (File e = f.openNextFile(); e; e = f.openNextFile()){
-      if (count++) res->print(",");
-      res->print("{\"name\":\""); res->print(e.name()); res->print("\",");
-      res->print("\"dir\":"); res->print(e.isDirectory()? "true" : "false"); res->print(",");
-      res->print("\"size\":"); res->print((uint32_t)e.size()); res->print("}");
-      e.close();
-      if (count >= 500) break;
-    }
-    f.close();
-    res->print("]}");
     lfs_unlock();
-    req->send(res);
+    sendJsonArray(req, "{\"path\":" + jsonQuote(path) + ",\"items\":", "}",
+      [f](size_t i, JsonDocument& o) mutable {
+        if (i >= 500) return false;
+        lfs_lock();
+        File e = f.openNextFile();
+        bool got = (bool)e;
+        if (got) {
+          o["name"] = e.name();
+          o["dir"]  = e.isDirectory();
+          o["size"] = (uint32_t)e.size();
+          e.close();
+        }
+        lfs_unlock();
+        return got;
+      },
+      [f]() mutable { lfs_lock(); f.close(); lfs_unlock(); });
   });
 
   server.on("/api/fs/read", HTTP_GET, [](AsyncWebServerRequest* req){
@@ -1373,6 +1994,35 @@ bool HttpApi::begin(){
     req->send(r);
   });
 
+  // Job workers (see deferToJob); GET /api/jobs/<id> polls a 202 job
+  s_logs_mtx = xSemaphoreCreateMutex();
+  s_boot_tag = esp_random();
+  s_jobs_mtx = xSemaphoreCreateMutex();
+  s_job_q    = xQueueCreate(kJobSlots, sizeof(Job*));
+  for (size_t i = 0; i < kJobWorkers; ++i) {
+    char name[12];
+    snprintf(name, sizeof(name), "http_job%u", (unsigned)i);
+    xTaskCreate(jobTask, name, 6144, nullptr, 1, nullptr);
+  }
+  server.on("/api/jobs", HTTP_GET, [&, hasSession](AsyncWebServerRequest* req){
+    if (!(isLoggedIn || hasSession(req))) { sendJsonText(req, 401, "{\"error\":\"unauthorized\"}"); return; }
+    sendJobStatus(req);
+  });
+
+  // Live feed (see feedTask)
+  s_events.setFilter([hasSession](AsyncWebServerRequest* r){ return isLoggedIn || hasSession(r); });
+  s_events.onConnect([](AsyncEventSourceClient* c){
+    if (s_events.count() > kFeedClients) { c->close(); return; }
+    c->send("{}", "hello", 0, 3000);         // reconnect after 3 s if dropped
+  });
+  server.addHandler(&s_events);
+  s_feed_q   = xQueueCreate(16, sizeof(FeedMsg));
+  s_dash_mtx = xSemaphoreCreateMutex();
+  static FeedCtx feedCtx{ &up_, &config_ };
+  // 6 KB: also builds the dashboard snapshot and seeds it from the spool
+  xTaskCreate(feedTask, "http_evt", 6144, &feedCtx, 1, nullptr);
+  up_.onResult([]{ FeedMsg m{}; m.kind = FeedUpload; feedPost(m); });
+
   // Helpful 404
   server.onNotFound([](AsyncWebServerRequest* req){
     req->send(404, "text/plain", "Not found. Try /, /login, /configuration or /api/wifi/status");
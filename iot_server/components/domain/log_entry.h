@@ -6,6 +6,8 @@ struct LogEntry {
   std::string rfid;
   std::string ts_iso;
   bool        sent = false;
+  // Rejected by the server as non-retryable (dead-lettered); never resent
+  bool        dead = false;
   // New: error/status message for upload attempts (e.g., NET_ERR, HTTP_500, TIMEOUT)
   std::string message;
 };
@@ -0,0 +1,162 @@
+#include "dns_cache.h"
+#include <WiFiUdp.h>
+
+DnsCache& DnsCache::instance(){
+  static DnsCache c;
+  return c;
+}
+
+const char* DnsCache::sourceName(Source s){
+  switch (s) {
+    case Source::Literal: return "literal";
+    case Source::Cache:   return "cache";
+    case Source::Query:   return "query";
+    case Source::Stale:   return "stale";
+    default:              return "none";
+  }
+}
+
+// Skips a (possibly compressed) name starting at p; returns the offset after it
+static size_t skipName(const uint8_t* buf, size_t len, size_t p){
+  while (p < len) {
+    uint8_t l = buf[p];
+    if (l == 0)             return p + 1;
+    if ((l & 0xC0) == 0xC0) return p + 2;   // pointer ends the name
+    p += 1 + l;
+  }
+  return len;
+}
+
+// True if rsp answers the query in q (header + question section, qlen
+// bytes): a response to a standard query with the same id, not truncated,
+// echoing our question (names compared without case)
+static bool answersQuery(const uint8_t* rsp, size_t len, const uint8_t* q, size_t qlen){
+  if (len < qlen) return false;
+  if (rsp[0] != q[0] || rsp[1] != q[1]) return false;          // id
+  if (!(rsp[2] & 0x80) || (rsp[2] & 0x78) || (rsp[2] & 0x02)) return false;   // QR, opcode, TC
+  if (rsp[4] != 0 || rsp[5] != 1) return false;                // QDCOUNT 1
+  for (size_t i = 12; i < qlen; ++i)
+    if (tolower(rsp[i]) != tolower(q[i])) return false;
+  return true;
+}
+
+// One A query over UDP to the STA's DNS server. The answer's TTL is the
+// minimum over the records followed (CNAME chain included).
+bool DnsCache::query(const char* host, IPAddress& ip, uint32_t& ttl_s){
+  IPAddress server = WiFi.dnsIP(0);
+  if ((uint32_t)server == 0) return false;
+
+  uint8_t pkt[300];
+  size_t n = 0;
+  const uint16_t id = (uint16_t)(qid_.fetch_add(1) + 1) ^ (uint16_t)esp_random();
+  const uint8_t hdr[12] = { (uint8_t)(id >> 8), (uint8_t)id, 0x01, 0x00,  // RD
+                            0, 1, 0, 0, 0, 0, 0, 0 };
+  memcpy(pkt, hdr, sizeof(hdr)); n = sizeof(hdr);
+  for (const char* s = host; *s; ) {
+    const char* dot = strchr(s, '.');
+    size_t l = dot ? (size_t)(dot - s) : strlen(s);
+    if (!l || l > 63 || n + l + 6 >= sizeof(pkt)) return false;
+    pkt[n++] = (uint8_t)l;
+    memcpy(pkt + n, s, l); n += l;
+    s += l + (dot ? 1 : 0);
+  }
+  const uint8_t tail[5] = { 0, 0, 1, 0, 1 };          // root, QTYPE A, QCLASS IN
+  memcpy(pkt + n, tail, sizeof(tail)); n += sizeof(tail);
+
+  WiFiUDP udp;
+  if (!udp.begin(0)) return false;
+  bool ok = false;
+  if (udp.beginPacket(server, 53) && udp.write(pkt, n) == n && udp.endPacket()) {
+    uint32_t t0 = millis();
+    while (millis() - t0 < kQueryTimeout) {
+      int len = udp.parsePacket();
+      if (len <= 0) { vTaskDelay(pdMS_TO_TICKS(10)); continue; }
+      // only from the resolver we asked; whatever is not read is dropped,
+      // or parsePacket() would not move on to the next datagram
+      bool from = (udp.remoteIP() == server && udp.remotePort() == 53);
+      uint8_t rsp[512];
+      len = from ? udp.read(rsp, sizeof(rsp)) : 0;
+      udp.flush();
+      if (len < 12 || !answersQuery(rsp, len, pkt, n)) continue;   // stray or spoofed
+      if ((rsp[3] & 0x0F) != 0) break;                // NXDOMAIN / SERVFAIL
+      uint16_t an = (rsp[6] << 8) | rsp[7];
+      size_t p = n;                                   // past the echoed question
+      uint32_t ttl = kMaxTtlS;
+      while (an-- && p + 10 <= (size_t)len) {
+        p = skipName(rsp, len, p);
+        if (p + 10 > (size_t)len) break;
+        uint16_t type = (rsp[p] << 8) | rsp[p + 1];
+        uint16_t cls  = (rsp[p + 2] << 8) | rsp[p + 3];
+        uint32_t t = ((uint32_t)rsp[p + 4] << 24) | ((uint32_t)rsp[p + 5] << 16) |
+                     ((uint32_t)rsp[p + 6] << 8)  |  (uint32_t)rsp[p + 7];
+        uint16_t rdlen = (rsp[p + 8] << 8) | rsp[p + 9];
+        p += 10;
+        if (p + rdlen > (size_t)len) break;
+        if (t < ttl) ttl = t;
+        if (type == 1 && cls == 1 && rdlen == 4) {
+          ip = IPAddress(rsp[p], rsp[p + 1], rsp[p + 2], rsp[p + 3]);
+          ttl_s = ttl;
+          ok = true;
+          break;
+        }
+        p += rdlen;
+      }
+      break;
+    }
+  }
+  udp.stop();
+  return ok;
+}
+
+bool DnsCache::resolve(const char* host, IPAddress& ip, Source& src, uint32_t& took_ms){
+  const uint32_t t0 = millis();
+  src = Source::None;
+  if (!host || !*host) { took_ms = 0; return false; }
+  if (ip.fromString(host)) { src = Source::Literal; took_ms = 0; return true; }
+
+  bool have_last = false;
+  IPAddress last;
+  xSemaphoreTake(mtx_, portMAX_DELAY);
+  auto it = table_.find(host);
+  if (it != table_.end()) {
+    if ((int32_t)(it->second.expires_ms - millis()) > 0) {
+      ip = it->second.ip;
+      src = Source::Cache;
+      xSemaphoreGive(mtx_);
+      took_ms = millis() - t0;
+      return true;
+    }
+    have_last = true;
+    last = it->second.ip;
+  }
+  xSemaphoreGive(mtx_);
+
+  // The lookup itself runs unlocked: it can take kQueryTimeout plus the
+  // lwIP fallback, and other hosts' cache hits must not wait for it
+  uint32_t ttl = 0;
+  bool ok = query(host, ip, ttl);
+  if (!ok && WiFi.hostByName(host, ip) == 1) { ok = true; ttl = kFallbackTtlS; }
+  if (ok) {
+    if (ttl < kMinTtlS) ttl = kMinTtlS;
+    if (ttl > kMaxTtlS) ttl = kMaxTtlS;
+    xSemaphoreTake(mtx_, portMAX_DELAY);
+    Entry& e = table_[host];
+    e.ip = ip; e.ttl_s = ttl; e.expires_ms = millis() + ttl * 1000UL;
+    xSemaphoreGive(mtx_);
+    src = Source::Query;
+  } else if (have_last) {
+    ip = last;                                        // resolver down: last known address
+    src = Source::Stale;
+    ok = true;
+    Serial.printf("[DNS] %s: lookup failed, using last known %s\n", host, ip.toString().c_str());
+  }
+  took_ms = millis() - t0;
+  return ok;
+}
+
+void DnsCache::invalidate(const char* host){
+  xSemaphoreTake(mtx_, portMAX_DELAY);
+  auto it = table_.find(host ? host : "");
+  if (it != table_.end()) it->second.expires_ms = millis();   // keep it as the stale fallback
+  xSemaphoreGive(mtx_);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <map>
+#include <string>
+
+// Hostname -> IPv4 cache for the uplink. Entries live as long as the TTL of
+// the DNS answer (queried directly from the STA's resolver, since lwIP does
+// not hand TTLs out); when the resolver fails, the last known address is
+// used rather than failing the upload.
+class DnsCache {
+public:
+  enum class Source : uint8_t { None, Literal, Cache, Query, Stale };
+
+  struct Entry {
+    IPAddress ip;
+    uint32_t  expires_ms = 0;
+    uint32_t  ttl_s      = 0;
+  };
+
+  // true if an address was found; took_ms covers the whole lookup
+  bool resolve(const char* host, IPAddress& ip, Source& src, uint32_t& took_ms);
+  void invalidate(const char* host);       // e.g. after a connect failure
+
+  static const char* sourceName(Source s);
+  static DnsCache& instance();
+
+private:
+  static constexpr uint32_t kMinTtlS      = 30;     // floor for very short TTLs
+  static constexpr uint32_t kMaxTtlS      = 3600;
+  static constexpr uint32_t kFallbackTtlS = 300;    // lwIP lookup, TTL unknown
+  static constexpr uint32_t kQueryTimeout = 2000;
+
+  bool query(const char* host, IPAddress& ip, uint32_t& ttl_s);
+
+  std::map<std::string, Entry> table_;               // under mtx_, never held across a lookup
+  SemaphoreHandle_t            mtx_ = xSemaphoreCreateMutex();
+  std::atomic<uint16_t>        qid_{0};            // queries run concurrently, unlocked
+};
@@ -12,4 +12,6 @@ public:
   virtual bool markSent(const std::vector<domain::LogEntry>&) = 0;
   // New: set a message for the provided entries (keeps sent=false)
   virtual bool markFailed(const std::vector<domain::LogEntry>&, const std::string& message) = 0;
+  // Quarantine entries the server rejected for good (dead letter); keeps the reason
+  virtual bool markDead(const std::vector<domain::LogEntry>&, const std::string& message) = 0;
 };
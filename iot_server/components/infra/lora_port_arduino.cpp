@@ -8,7 +8,7 @@ class LoRaPortArduino : public LoRaPort {
 public:
   explicit LoRaPortArduino(long f): freq_(f) {}
   bool begin() override {
-    spi_lock();
+    spi_lock(SpiClient::Radio);
     bool ok = LoRa.begin(freq_);
     if (ok){
       // Match sender radio params
@@ -27,9 +27,12 @@ public:
   }
   void onPacket(Handler h) override { h_ = std::move(h); }
   void pollOnce() override {
-    spi_lock();
+    spi_lock(SpiClient::Radio);
     int plen = LoRa.parsePacket();
     if (plen <= 0){ spi_unlock(); return; }
+    // RSSI/SNR are register reads too, so they are taken before the bus is released
+    int rssi = LoRa.packetRssi();
+    float snr = LoRa.packetSnr();
     // Expect a 5-byte header {net,dst,src,seq,len}, followed by len bytes of payload
     uint8_t hdr[5] = {0};
     std::string payload;
@@ -70,9 +73,9 @@ public:
     // Debug print raw RX
     if (hadHeader){
       Serial.printf("[LoRaRF] RX net=0x%02X dst=0x%02X src=0x%02X seq=%u len=%u rssi=%d snr=%.1f payload='%s'\n",
-                    hdr[0], hdr[1], hdr[2], (unsigned)hdr[3], (unsigned)hdr[4], LoRa.packetRssi(), LoRa.packetSnr(), payload.c_str());
+                    hdr[0], hdr[1], hdr[2], (unsigned)hdr[3], (unsigned)hdr[4], rssi, snr, payload.c_str());
     } else {
-      Serial.printf("[LoRaRF] RX rssi=%d snr=%.1f payload='%s' (no header)\n", LoRa.packetRssi(), LoRa.packetSnr(), payload.c_str());
+      Serial.printf("[LoRaRF] RX rssi=%d snr=%.1f payload='%s' (no header)\n", rssi, snr, payload.c_str());
     }
     if (h_) h_(payload);
   }
@@ -17,7 +17,7 @@ public:
   }
   std::vector<domain::LogEntry> listUnsent(size_t limit) override {
     std::vector<domain::LogEntry> out; out.reserve(limit);
-    for (const auto& e : items_) { if (!e.sent) { out.push_back(e); if (out.size()>=limit) break; } }
+    for (const auto& e : items_) { if (!e.sent && !e.dead) { out.push_back(e); if (out.size()>=limit) break; } }
     return out;
   }
   bool markSent(const std::vector<domain::LogEntry>& sent) override {
@@ -40,6 +40,16 @@ public:
     }
     return true;
   }
+  bool markDead(const std::vector<domain::LogEntry>& dead, const std::string& message) override {
+    for (auto& it : items_) {
+      for (const auto& d : dead) {
+        if (it.scanner_id==d.scanner_id && it.rfid==d.rfid && it.ts_iso==d.ts_iso) {
+          it.dead = true; it.message = message;
+        }
+      }
+    }
+    return true;
+  }
 };
 
 LogRepo* makeMemLogRepo(){ return new MemLogRepo(); }
@@ -0,0 +1,143 @@
+#include "metrics.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace metrics {
+
+// Every metric is a static object; they link themselves in during static
+// initialization (single-threaded), so the list is never written afterwards
+static Metric* s_head = nullptr;
+
+Metric::Metric(const char* name, const char* help, Kind kind)
+  : name_(name), help_(help), kind_(kind), next_(nullptr) {
+  // append, so the export follows declaration order
+  Metric** p = &s_head;
+  while (*p) p = &(*p)->next_;
+  *p = this;
+}
+
+Histogram::Histogram(const char* name, const char* help, const uint32_t* bounds, uint8_t n, uint32_t per_base,
+                     const char* labels)
+  : Metric(name, help, KindHistogram), labels_(labels), bounds_(bounds),
+    n_(n > kMaxBuckets ? kMaxBuckets : n), per_base_(per_base ? per_base : 1) {}
+
+static const uint32_t kSdBoundsUs[]     = { 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000 };
+static const uint32_t kUploadBoundsMs[] = { 100, 250, 500, 1000, 2000, 3000, 5000, 8000, 12000, 20000, 30000 };
+static const uint32_t kSpiBoundsUs[]    = { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000 };
+static constexpr uint8_t kSpiBuckets    = sizeof(kSpiBoundsUs) / sizeof(kSpiBoundsUs[0]);
+
+Counter   lora_rx_packets  ("lora_rx_packets_total",         "LoRa payloads accepted and queued for ingest");
+Counter   lora_rx_invalid  ("lora_rx_invalid_total",         "LoRa payloads rejected by validation");
+Counter   lora_rx_dropped  ("lora_rx_dropped_total",         "LoRa payloads dropped because the RX queue was full");
+Gauge     lora_rx_queue_max("lora_rx_queue_high_water",      "Deepest the LoRa RX queue has been since boot");
+Histogram sd_op_seconds    ("sd_op_seconds",                 "Time the SD card was held per operation or locked section",
+                            kSdBoundsUs, sizeof(kSdBoundsUs) / sizeof(kSdBoundsUs[0]), 1000000);
+Histogram spi_wait_radio    ("spi_wait_seconds",           "Time an SPI bus client waited for the bus",
+                             kSpiBoundsUs, kSpiBuckets, 1000000, "client=\"radio\"");
+Histogram spi_wait_sd_ingest("spi_wait_seconds",           "Time an SPI bus client waited for the bus",
+                             kSpiBoundsUs, kSpiBuckets, 1000000, "client=\"sd_ingest\"");
+Histogram spi_wait_sd_bulk  ("spi_wait_seconds",           "Time an SPI bus client waited for the bus",
+                             kSpiBoundsUs, kSpiBuckets, 1000000, "client=\"sd_bulk\"");
+Histogram spi_hold_radio    ("spi_hold_seconds",           "Time an SPI bus client held the bus per grant",
+                             kSpiBoundsUs, kSpiBuckets, 1000000, "client=\"radio\"");
+Histogram spi_hold_sd_ingest("spi_hold_seconds",           "Time an SPI bus client held the bus per grant",
+                             kSpiBoundsUs, kSpiBuckets, 1000000, "client=\"sd_ingest\"");
+Histogram spi_hold_sd_bulk  ("spi_hold_seconds",           "Time an SPI bus client held the bus per grant",
+                             kSpiBoundsUs, kSpiBuckets, 1000000, "client=\"sd_bulk\"");
+Gauge     spool_pending    ("spool_pending_items",           "Records still in the SD spool after the last upload");
+Counter   upload_requests  ("upload_requests_total",         "Upload requests sent");
+Counter   upload_failures  ("upload_failures_total",         "Upload requests that failed or got a non-2xx answer");
+Counter   upload_bytes     ("upload_bytes_total",            "Upload request body bytes sent");
+Counter   upload_items     ("upload_items_total",            "Records accepted by the server");
+Histogram upload_seconds   ("upload_request_seconds",        "Upload request latency, submit to response",
+                            kUploadBoundsMs, sizeof(kUploadBoundsMs) / sizeof(kUploadBoundsMs[0]), 1000);
+Counter   export_bytes     ("http_export_bytes_total",       "Bytes sent by /api/export");
+Gauge     export_rate      ("http_export_last_bytes_per_second", "Throughput of the last finished /api/export");
+
+static void header(String& out, const char* name, const char* help, const char* type){
+  out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+  out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+}
+
+static void sample(String& out, const char* name, const char* suffix, const char* labels, const char* value){
+  out += name; out += suffix;
+  if (labels) { out += '{'; out += labels; out += '}'; }
+  out += ' '; out += value; out += '\n';
+}
+
+static void sampleU(String& out, const char* name, const char* suffix, const char* labels, uint32_t v){
+  char b[12];
+  snprintf(b, sizeof(b), "%u", (unsigned)v);
+  sample(out, name, suffix, labels, b);
+}
+
+static void gaugeU(String& out, const char* name, const char* help, uint32_t v){
+  header(out, name, help, "gauge");
+  sampleU(out, name, "", nullptr, v);
+}
+
+// Tasks whose stack headroom is worth watching; missing ones are skipped
+static const char* const kTasks[] = {
+  "loopTask", "async_tcp", "lora_rx", "lora_ing", "upl_task", "upl_sd", "upl_w1", "upl_w2", "upl_w3",
+  "http_evt", "http_job0", "http_job1",
+};
+
+static void renderSystem(String& out){
+  gaugeU(out, "heap_free_bytes",          "Free internal heap",                    heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+  gaugeU(out, "heap_min_free_bytes",      "Lowest free internal heap since boot",  heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+  gaugeU(out, "heap_largest_block_bytes", "Largest allocatable internal block",    heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+  gaugeU(out, "uptime_seconds",           "Seconds since boot",                    millis() / 1000);
+
+  const char* name = "task_stack_free_bytes";
+  header(out, name, "Least free stack each task has had (high-water mark)", "gauge");
+  char labels[32];
+  for (const char* t : kTasks) {
+    TaskHandle_t h = xTaskGetHandle(t);
+    if (!h) continue;
+    snprintf(labels, sizeof(labels), "task=\"%s\"", t);
+    // ESP-IDF counts stack in bytes
+    sampleU(out, name, "", labels, (uint32_t)uxTaskGetStackHighWaterMark(h));
+  }
+}
+
+void render(String& out){
+  char v[32], le[64];
+  const char* prev = nullptr;                // one HELP/TYPE per family
+  for (Metric* m = s_head; m; prev = m->name_, m = m->next_) {
+    switch (m->kind_) {
+      case Metric::KindCounter:
+        header(out, m->name_, m->help_, "counter");
+        sampleU(out, m->name_, "", nullptr, static_cast<Counter*>(m)->value());
+        break;
+      case Metric::KindGauge:
+        header(out, m->name_, m->help_, "gauge");
+        snprintf(v, sizeof(v), "%d", (int)static_cast<Gauge*>(m)->value());
+        sample(out, m->name_, "", nullptr, v);
+        break;
+      case Metric::KindHistogram: {
+        auto* h = static_cast<Histogram*>(m);
+        if (!prev || strcmp(prev, m->name_) != 0) header(out, m->name_, m->help_, "histogram");
+        const char* lb = h->labels_ ? h->labels_ : "";
+        const char* sep = h->labels_ ? "," : "";
+        // buckets are read one by one while others may observe, so a scrape
+        // can be off by the observations that land during it
+        uint32_t cum = 0;
+        for (uint8_t i = 0; i <= h->n_; ++i) {
+          cum += h->counts_[i].load(std::memory_order_relaxed);
+          if (i < h->n_) snprintf(le, sizeof(le), "%s%sle=\"%g\"", lb, sep, (double)h->bounds_[i] / h->per_base_);
+          else           snprintf(le, sizeof(le), "%s%sle=\"+Inf\"", lb, sep);
+          sampleU(out, m->name_, "_bucket", le, cum);
+        }
+        // fixed point: %g keeps 6 digits, too few for a long-running sum
+        snprintf(v, sizeof(v), "%.6f", (double)h->sum_.load(std::memory_order_relaxed) / h->per_base_);
+        sample(out, m->name_, "_sum", h->labels_, v);
+        sampleU(out, m->name_, "_count", h->labels_, cum);
+        break;
+      }
+    }
+  }
+  renderSystem(out);
+}
+
+} // namespace metrics
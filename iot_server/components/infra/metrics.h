@@ -0,0 +1,117 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <stdint.h>
+
+// Process-wide counters, gauges and fixed-bucket histograms, exported as
+// Prometheus text by GET /api/metrics. Updating one is a relaxed atomic op
+// (a histogram adds a scan over at most kMaxBuckets bounds): no lock, no
+// allocation, safe from any task. Values are 32-bit, since 64-bit atomics
+// take a lock on this CPU; a wrapped counter reads as a reset to rate().
+// Histogram sums are the exception: a 32-bit sum of microseconds wraps
+// after 71 minutes, out of step with its _count, so they pay for the
+// short critical section of a 64-bit add.
+namespace metrics {
+
+class Metric {
+public:
+  enum Kind : uint8_t { KindCounter, KindGauge, KindHistogram };
+  Metric(const Metric&) = delete;
+  Metric& operator=(const Metric&) = delete;
+
+protected:
+  Metric(const char* name, const char* help, Kind kind);
+
+private:
+  friend void render(String& out);
+  const char* name_;
+  const char* help_;
+  Kind        kind_;
+  Metric*     next_;
+};
+
+class Counter : public Metric {
+public:
+  Counter(const char* name, const char* help) : Metric(name, help, KindCounter) {}
+  void     inc(uint32_t n = 1) { v_.fetch_add(n, std::memory_order_relaxed); }
+  uint32_t value() const       { return v_.load(std::memory_order_relaxed); }
+private:
+  std::atomic<uint32_t> v_{0};
+};
+
+class Gauge : public Metric {
+public:
+  Gauge(const char* name, const char* help) : Metric(name, help, KindGauge) {}
+  void    set(int32_t v) { v_.store(v, std::memory_order_relaxed); }
+  void    add(int32_t d) { v_.fetch_add(d, std::memory_order_relaxed); }
+  // High-water mark: only ever raises the value
+  void    setMax(int32_t v) {
+    int32_t cur = v_.load(std::memory_order_relaxed);
+    while (v > cur && !v_.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+  }
+  int32_t value() const  { return v_.load(std::memory_order_relaxed); }
+private:
+  std::atomic<int32_t> v_{0};
+};
+
+// Observations are integers in the histogram's own unit (us, ms, ...);
+// `per_base` of them make one exported base unit, so a histogram fed in
+// microseconds with per_base 1000000 is exported in seconds.
+// Histograms sharing a name form one family told apart by `labels`
+// (e.g. client="radio"); declare them next to each other.
+class Histogram : public Metric {
+public:
+  static constexpr uint8_t kMaxBuckets = 12;
+  // bounds: ascending upper bounds, at most kMaxBuckets; +Inf is implicit
+  Histogram(const char* name, const char* help, const uint32_t* bounds, uint8_t n, uint32_t per_base,
+            const char* labels = nullptr);
+  void observe(uint32_t v) {
+    uint8_t i = 0;
+    while (i < n_ && v > bounds_[i]) ++i;
+    counts_[i].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(v, std::memory_order_relaxed);
+  }
+private:
+  friend void render(String& out);
+  const char*           labels_;
+  const uint32_t*       bounds_;
+  uint8_t               n_;
+  uint32_t              per_base_;
+  std::atomic<uint32_t> counts_[kMaxBuckets + 1] = {};   // per bucket, last is +Inf
+  std::atomic<uint64_t> sum_{0};
+};
+
+// Appends every registered metric, plus heap and task stack figures sampled
+// now, in the Prometheus text exposition format (0.0.4)
+void render(String& out);
+
+// --- LoRa receive path ---
+extern Counter   lora_rx_packets;        // valid payloads queued for ingest
+extern Counter   lora_rx_invalid;        // payloads that failed validation
+extern Counter   lora_rx_dropped;        // valid payloads lost to a full queue
+extern Gauge     lora_rx_queue_max;      // deepest the RX queue has been
+
+// --- SD card ---
+extern Histogram sd_op_seconds;          // SD bus held per operation / locked section
+
+// --- SPI bus arbiter (spi_lock), per client class ---
+extern Histogram spi_wait_radio;         // spi_lock() call -> bus granted
+extern Histogram spi_wait_sd_ingest;
+extern Histogram spi_wait_sd_bulk;
+extern Histogram spi_hold_radio;         // grant -> unlock or yield
+extern Histogram spi_hold_sd_ingest;
+extern Histogram spi_hold_sd_bulk;
+
+// --- uploader ---
+extern Gauge     spool_pending;          // items left in the spool after the last upload
+extern Counter   upload_requests;
+extern Counter   upload_failures;        // transport errors and non-2xx answers
+extern Counter   upload_bytes;           // request body bytes sent
+extern Counter   upload_items;           // records the server accepted
+extern Histogram upload_seconds;         // submit -> response, per request
+
+// --- HTTP ---
+extern Counter   export_bytes;           // /api/export body bytes sent
+extern Gauge     export_rate;            // bytes/s of the last finished export
+
+} // namespace metrics
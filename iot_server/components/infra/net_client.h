@@ -1,5 +1,40 @@
 #pragma once
 #include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+// Request body produced on demand, so a payload never has to sit in RAM as
+// one string. size() must be exact: it is sent as Content-Length.
+class BodySource {
+public:
+  virtual ~BodySource() = default;
+  virtual size_t size() const = 0;
+  virtual size_t read(uint8_t* dst, size_t max) = 0;   // 0 = end of body
+  virtual void   rewind() = 0;                         // restart for retries/redirects
+};
+
+// BodySource over an in-memory string (small, already built bodies)
+class StringBody : public BodySource {
+  const std::string& s_;
+  size_t pos_ = 0;
+public:
+  explicit StringBody(const std::string& s) : s_(s) {}
+  size_t size() const override { return s_.size(); }
+  size_t read(uint8_t* dst, size_t max) override {
+    size_t n = s_.size() - pos_; if (n > max) n = max;
+    s_.copy((char*)dst, n, pos_); pos_ += n; return n;
+  }
+  void rewind() override { pos_ = 0; }
+};
+
+// Where the time of the last request went
+struct NetTiming {
+  uint32_t    resolve_ms = 0;      // DNS lookup (0 when served from cache)
+  uint32_t    connect_ms = 0;      // TCP connect + TLS handshake
+  uint32_t    request_ms = 0;      // send body, wait for and read the response
+  const char* dns        = "none"; // literal | cache | query | stale | none
+};
+
 class NetClient {
 public:
   virtual ~NetClient() = default;
@@ -8,5 +43,41 @@ public:
                         int& code,
                         std::string& resp,
                         const std::string& apiKey = std::string()) = 0;
+  // Streams the body from its source with a precomputed Content-Length
+  virtual bool postBody(const std::string& url,
+                        BodySource& body,
+                        int& code,
+                        std::string& resp,
+                        const std::string& apiKey = std::string(),
+                        const char* contentType = "application/json") = 0;
+  // Server-requested delay from the last response's Retry-After (0 if none)
+  virtual uint32_t retryAfterMs() const { return 0; }
+  virtual NetTiming lastTiming() const { return NetTiming(); }
+  // Warm caches for url ahead of the first request (e.g. on Wi-Fi up)
+  virtual void      prewarm(const std::string& url) { (void)url; }
+
+  // Windowed transports (MQTT QoS1) keep several bodies unacknowledged at
+  // once. window() > 1 means submit/collect are supported for that url;
+  // postBody stays the synchronous path for everything else.
+  virtual uint8_t  window(const std::string& url) const { (void)url; return 1; }
+  // Queues the body and returns a ticket (0 = not accepted)
+  virtual uint32_t submit(const std::string& url, BodySource& body,
+                          const std::string& apiKey, const char* contentType) {
+    (void)url; (void)body; (void)apiKey; (void)contentType; return 0;
+  }
+  // true once the ticket settled (code filled in); false while still in flight
+  virtual bool     collect(uint32_t ticket, uint32_t wait_ms, int& code, std::string& resp) {
+    (void)ticket; (void)wait_ms; (void)resp; code = -1; return true;
+  }
+  // Caller gave up on a ticket; drop its bookkeeping
+  virtual void     forget(uint32_t ticket) { (void)ticket; }
+  // How long a ticket may stay unsettled before the caller gives up on it
+  // and sends the records again; 0 = never, the transport settles every
+  // ticket itself (and a resend would only duplicate one it still holds)
+  virtual uint32_t ackTimeoutMs(const std::string& url) const { (void)url; return 15000; }
 };
 NetClient* makeNetClientHttps();
+NetClient* makeNetClientMqtt();
+// Picks HTTPS or MQTT per request from the URL scheme (mqtt://, mqtts://);
+// nullptr when out of memory
+NetClient* makeNetClient();
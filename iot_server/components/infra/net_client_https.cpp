@@ -2,13 +2,34 @@
 #include <Arduino.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include "dns_cache.h"
 
 static bool isHttpsUrl(const String& s){ return s.startsWith("https://"); }
 
+// Arduino Stream view of a BodySource: HTTPClient pulls the body through
+// its own 1460-byte buffer, so nothing larger is ever allocated here.
+class BodyStream : public Stream {
+  BodySource& src_;
+  size_t left_;
+public:
+  explicit BodyStream(BodySource& s) : src_(s), left_(s.size()) {}
+  int available() override { return (int)left_; }
+  size_t readBytes(char* buf, size_t n) override {
+    size_t got = src_.read((uint8_t*)buf, n);
+    left_ -= (got <= left_) ? got : left_;
+    if (!got) left_ = 0;                 // source ended early; stop the writer
+    return got;
+  }
+  int read() override { char c; return readBytes(&c, 1) ? (uint8_t)c : -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+};
+
 // Helper: try a single POST to url with given client; returns true if code>0
 static bool doPostOnce(HTTPClient& http, const String& url,
                        WiFiClient* client,
-                       const std::string& json,
+                       BodySource& body, const char* contentType,
                        int& code, std::string& resp,
                        const std::string& apiKey)
 {
@@ -23,19 +44,22 @@ static bool doPostOnce(HTTPClient& http, const String& url,
   http.setTimeout(8000);
   http.setReuse(false);
   // Keep HTTP/1.1 (default)
-  http.addHeader("Content-Type","application/json");
+  http.addHeader("Content-Type", contentType);
   http.addHeader("Accept","*/*");
   http.addHeader("Connection","close");
   if (!apiKey.empty()){
     http.addHeader("X-API-Key", apiKey.c_str());
   }
 
-  // Ask HTTPClient to capture the Location header (for redirects)
-  static const char* hdrs[] = {"Location"};
-  http.collectHeaders(hdrs, 1);
+  // Ask HTTPClient to capture the Location header (for redirects) and
+  // Retry-After (429/503 back-pressure)
+  static const char* hdrs[] = {"Location", "Retry-After"};
+  http.collectHeaders(hdrs, 2);
 
-  // Use the String overload to avoid const->nonconst cast warnings
-  code = http.POST(String(json.c_str()));
+  // Stream the body with an exact Content-Length
+  body.rewind();
+  BodyStream bs(body);
+  code = http.sendRequest("POST", &bs, body.size());
   resp = http.getString().c_str();
 
   // Debug redirect target if any
@@ -50,12 +74,90 @@ static bool doPostOnce(HTTPClient& http, const String& url,
   return (code > 0);
 }
 
+// Retry-After is either delta-seconds or an HTTP-date; only the former is
+// honoured (servers that throttle devices use it), dates count as absent.
+static uint32_t parseRetryAfterMs(const String& v){
+  if (!v.length()) return 0;
+  for (size_t i=0;i<v.length();++i) if (v[i]<'0' || v[i]>'9') return 0;
+  long s = v.toInt();
+  if (s <= 0) return 0;
+  if (s > 3600) s = 3600;
+  return (uint32_t)s * 1000UL;
+}
+
+// "https://host:port/path" -> host, port (default per scheme)
+static bool splitHostPort(const String& url, String& host, uint16_t& port){
+  int s = url.indexOf("://");
+  if (s < 0) return false;
+  s += 3;
+  int end = s;
+  while (end < (int)url.length() && url[end] != '/' && url[end] != '?') end++;
+  String auth = url.substring(s, end);
+  int at = auth.lastIndexOf('@');
+  if (at >= 0) auth = auth.substring(at + 1);
+  int colon = auth.indexOf(':');
+  port = isHttpsUrl(url) ? 443 : 80;
+  if (colon >= 0) { port = (uint16_t)auth.substring(colon + 1).toInt(); auth = auth.substring(0, colon); }
+  host = auth;
+  return host.length() > 0;
+}
+
 class NetClientHttps : public NetClient {
+  uint32_t  retry_after_ms_ = 0;
+  NetTiming timing_;
+
+  // Resolves through the DNS cache and opens the connection ourselves, so
+  // HTTPClient finds it connected and skips its own lookup. The TLS session
+  // still gets the hostname for SNI and certificate checks.
+  bool preconnect(const String& url, WiFiClientSecure& tls, WiFiClient& plain){
+    String host; uint16_t port = 0;
+    if (!splitHostPort(url, host, port)) return false;
+
+    IPAddress ip;
+    DnsCache::Source src;
+    bool ok = DnsCache::instance().resolve(host.c_str(), ip, src, timing_.resolve_ms);
+    timing_.dns = DnsCache::sourceName(src);
+    if (!ok) return false;
+
+    uint32_t t0 = millis();
+    int rc = isHttpsUrl(url) ? tls.connect(ip, port, host.c_str(), nullptr, nullptr, nullptr)
+                             : plain.connect(ip, port);
+    timing_.connect_ms = millis() - t0;
+    if (!rc) {
+      // address may have moved; next lookup goes to the resolver again
+      DnsCache::instance().invalidate(host.c_str());
+      Serial.printf("[HTTP] Connect to %s (%s) failed\n", host.c_str(), ip.toString().c_str());
+    }
+    return rc != 0;
+  }
+
 public:
+  uint32_t retryAfterMs() const override { return retry_after_ms_; }
+  NetTiming lastTiming() const override { return timing_; }
+
+  void prewarm(const std::string& url) override {
+    String host; uint16_t port = 0;
+    IPAddress ip; DnsCache::Source src; uint32_t took = 0;
+    if (splitHostPort(String(url.c_str()), host, port) &&
+        DnsCache::instance().resolve(host.c_str(), ip, src, took))
+      Serial.printf("[HTTP] Prewarmed %s -> %s (%s, %ums)\n", host.c_str(), ip.toString().c_str(),
+                    DnsCache::sourceName(src), (unsigned)took);
+  }
+
   bool postJson(const std::string& url, const std::string& json,
                 int& code, std::string& resp,
                 const std::string& apiKey = std::string()) override
   {
+    StringBody body(json);
+    return postBody(url, body, code, resp, apiKey, "application/json");
+  }
+
+  bool postBody(const std::string& url, BodySource& body,
+                int& code, std::string& resp,
+                const std::string& apiKey = std::string(),
+                const char* contentType = "application/json") override
+  {
+    retry_after_ms_ = 0;
     HTTPClient http;
     WiFiClientSecure tls;
     WiFiClient plain;
@@ -70,10 +172,16 @@ public:
       sUrl += "/";
     }
 
-    // First attempt
+    // First attempt. If the pre-connect fails HTTPClient connects by name
+    // itself, as before.
+    timing_ = NetTiming();
     WiFiClient* client = isHttpsUrl(sUrl) ? static_cast<WiFiClient*>(&tls) : &plain;
-    bool ok = doPostOnce(http, sUrl, client, json, code, resp, apiKey);
+    preconnect(sUrl, tls, plain);
+    uint32_t t0 = millis();
+    bool ok = doPostOnce(http, sUrl, client, body, contentType, code, resp, apiKey);
+    timing_.request_ms = millis() - t0;
     if (!ok) return false;
+    retry_after_ms_ = parseRetryAfterMs(http.header("Retry-After"));
 
     // If we still get a redirect (e.g., 308), follow once manually
     if (code >= 300 && code < 400) {
@@ -94,7 +202,8 @@ public:
 
         // Fresh HTTPClient instance for the second request
         HTTPClient http2;
-        ok = doPostOnce(http2, location, client2, json, code, resp, apiKey);
+        ok = doPostOnce(http2, location, client2, body, contentType, code, resp, apiKey);
+        retry_after_ms_ = ok ? parseRetryAfterMs(http2.header("Retry-After")) : 0;
       }
     }
 
@@ -0,0 +1,328 @@
+#include "net_client.h"
+#include <Arduino.h>
+#include <esp_idf_version.h>
+#include <sdkconfig.h>
+#include <mqtt_client.h>
+#include <esp_crt_bundle.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <map>
+#include <memory>
+#include <new>
+
+static constexpr uint8_t kMqttWindow = 8;   // publishes awaiting PUBACK
+#ifdef CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS
+static constexpr uint32_t kOutboxExpiryMs = CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS;
+#else
+static constexpr uint32_t kOutboxExpiryMs = 30000;   // esp-mqtt's default
+#endif
+
+// MQTT uplink. The same body the HTTPS client would POST is published with
+// QoS1 on one persistent session:
+//   mqtt[s]://[user:pass@]host[:port]/iot/scans  ->  topic iot/scans/<scanner>
+// The client id is derived from the MAC and clean_session is off, so the
+// broker keeps the session and esp-mqtt's outbox re-sends unacknowledged
+// publishes after a reconnect instead of dropping them.
+//
+// Delivery is at-least-once. The outbox keeps re-sending a publish until
+// its PUBACK or until it expires (kOutboxExpiryMs after the last attempt),
+// so a ticket is never given up on a timer: publishing the records again
+// while the outbox still holds them puts both copies on the wire. It
+// settles 200 on PUBACK, or -1 once the publish is known gone (expired,
+// found missing from the outbox, or the session replaced); only then are
+// the records sent anew. A PUBACK lost after the broker took the message
+// still duplicates it, which per-record ids (UploadCfg::item_ids) absorb.
+class NetClientMqtt : public NetClient {
+  static constexpr size_t   kMaxPayload  = 8192;   // == out buffer, one message per batch
+  static constexpr uint32_t kStaleMs     = 60000;  // settled but never collected
+  static constexpr uint32_t kPollMs      = 500;    // outbox check while waiting for acks
+  static constexpr uint32_t kLostGraceMs = 2000;   // outbox empty this long = unacked are gone
+  static constexpr uint32_t kAckMarginMs = 5000;   // past the outbox expiry (IDF 4)
+
+  struct Slot { int code; uint32_t at; };           // code 0 = in flight, 200 = PUBACK
+
+  esp_mqtt_client_handle_t cli_ = nullptr;
+  std::string              broker_;                 // uri without the path
+  std::string              client_id_;
+  SemaphoreHandle_t        mtx_ = xSemaphoreCreateMutex();
+  SemaphoreHandle_t        evt_ = xSemaphoreCreateBinary();   // a slot settled
+  std::map<int, Slot>      slots_;
+  volatile bool            connected_ = false;
+  volatile uint32_t        reconnects_ = 0;
+  uint32_t                 empty_since_ = 0;      // outbox seen empty since (0 = not)
+
+  static bool isMqttUrl(const std::string& u){
+    return u.rfind("mqtt://", 0) == 0 || u.rfind("mqtts://", 0) == 0;
+  }
+
+  // "mqtts://u:p@host:8883/a/b" -> broker "mqtts://u:p@host:8883", topic "a/b"
+  static bool splitUrl(const std::string& url, std::string& broker, std::string& topic){
+    if (!isMqttUrl(url)) return false;
+    size_t host = url.find("://") + 3;
+    size_t slash = url.find('/', host);
+    broker = url.substr(0, slash);
+    topic  = (slash == std::string::npos) ? std::string("scans") : url.substr(slash + 1);
+    while (topic.size() && topic.back() == '/') topic.pop_back();
+    if (topic.empty()) topic = "scans";
+    return broker.size() > host;
+  }
+
+  static void onEvent(void* arg, esp_event_base_t, int32_t id, void* data){
+    auto* self = static_cast<NetClientMqtt*>(arg);
+    auto* ev   = static_cast<esp_mqtt_event_handle_t>(data);
+    switch ((esp_mqtt_event_id_t)id) {
+      case MQTT_EVENT_CONNECTED:
+        self->connected_ = true;
+        Serial.printf("[MQTT] Connected (session %s)\n", ev->session_present ? "resumed" : "new");
+        break;
+      case MQTT_EVENT_DISCONNECTED:
+        if (self->connected_) self->reconnects_++;
+        self->connected_ = false;
+        Serial.println("[MQTT] Disconnected; unacked publishes stay in the outbox");
+        break;
+      case MQTT_EVENT_PUBLISHED:
+        self->settle(ev->msg_id, 200);
+        break;
+#if ESP_IDF_VERSION_MAJOR >= 5
+      case MQTT_EVENT_DELETED:                 // expired in the outbox, never acked
+        self->settle(ev->msg_id, -1);
+        break;
+#endif
+      default:
+        break;
+    }
+  }
+
+  // Runs on the MQTT task. The ack may beat submit() to the map, so it
+  // records the slot either way; submit() then finds it already settled.
+  void settle(int msg_id, int code){
+    xSemaphoreTake(mtx_, portMAX_DELAY);
+    slots_[msg_id] = Slot{code, (uint32_t)millis()};
+    xSemaphoreGive(mtx_);
+    xSemaphoreGive(evt_);
+  }
+
+  // Settles every in-flight slot submitted no later than `before` as failed
+  void dropInFlight(uint32_t before){
+    const uint32_t now = millis();
+    xSemaphoreTake(mtx_, portMAX_DELAY);
+    for (auto& s : slots_)
+      if (!s.second.code && (int32_t)(before - s.second.at) >= 0) s.second = Slot{-1, now};
+    xSemaphoreGive(mtx_);
+    xSemaphoreGive(evt_);
+  }
+
+  // MQTT_EVENT_DELETED is only raised when esp-mqtt is built with
+  // CONFIG_MQTT_REPORT_DELETED_MESSAGES; otherwise an expired publish just
+  // vanishes. An outbox that stays empty while publishes are unsettled
+  // means those are gone; the grace covers a PUBACK whose event is still
+  // being dispatched after its outbox entry was deleted. Caller task only.
+  void reapLost(){
+#if ESP_IDF_VERSION_MAJOR >= 5
+    if (!cli_) return;
+    if (esp_mqtt_client_get_outbox_size(cli_) > 0) { empty_since_ = 0; return; }
+    const uint32_t now = millis();
+    if (!empty_since_) { empty_since_ = now | 1; return; }
+    if (now - empty_since_ < kLostGraceMs) return;
+    dropInFlight(empty_since_);
+#endif
+  }
+
+  bool ensure(const std::string& url, std::string& topic){
+    std::string broker;
+    if (!splitUrl(url, broker, topic)) return false;
+    if (cli_ && broker == broker_) return true;
+
+    if (cli_) {                              // broker changed: new session
+      esp_mqtt_client_stop(cli_);
+      esp_mqtt_client_destroy(cli_);
+      cli_ = nullptr;
+      connected_ = false;
+      empty_since_ = 0;
+      dropInFlight(millis());                // their outbox went with the client
+    }
+    if (client_id_.empty()) {
+      char id[24];
+      snprintf(id, sizeof(id), "iot-%012llx", (unsigned long long)ESP.getEfuseMac());
+      client_id_ = id;
+    }
+
+    esp_mqtt_client_config_t c = {};
+#if ESP_IDF_VERSION_MAJOR >= 5
+    c.broker.address.uri              = broker.c_str();
+    c.broker.verification.crt_bundle_attach = esp_crt_bundle_attach;
+    c.credentials.client_id           = client_id_.c_str();
+    c.session.disable_clean_session   = true;
+    c.session.keepalive               = 30;
+    c.buffer.size                     = 1024;
+    c.buffer.out_size                 = kMaxPayload + 256;
+#else
+    c.uri                   = broker.c_str();
+    c.crt_bundle_attach     = esp_crt_bundle_attach;
+    c.client_id             = client_id_.c_str();
+    c.disable_clean_session = true;
+    c.keepalive             = 30;
+    c.buffer_size           = 1024;
+    c.out_buffer_size       = kMaxPayload + 256;
+#endif
+    cli_ = esp_mqtt_client_init(&c);
+    if (!cli_) { Serial.println("[MQTT] ERROR: client init failed"); return false; }
+    esp_mqtt_client_register_event(cli_, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, &NetClientMqtt::onEvent, this);
+    if (esp_mqtt_client_start(cli_) != ESP_OK) {
+      esp_mqtt_client_destroy(cli_);
+      cli_ = nullptr;
+      Serial.println("[MQTT] ERROR: client start failed");
+      return false;
+    }
+    broker_ = broker;
+    Serial.printf("[MQTT] Session to %s as %s\n", broker_.c_str(), client_id_.c_str());
+    return true;
+  }
+
+public:
+  uint8_t window(const std::string& url) const override { return isMqttUrl(url) ? kMqttWindow : 1; }
+
+  uint32_t submit(const std::string& url, BodySource& body,
+                  const std::string& apiKey, const char* contentType) override
+  {
+    (void)contentType;                       // MQTT 3.1.1 has no content type
+    std::string topic;
+    if (!ensure(url, topic)) return 0;
+    if (!apiKey.empty()) topic += "/" + apiKey;
+
+    // QoS1 keeps a copy in the outbox until PUBACK anyway, so the body is
+    // materialized once here and released as soon as it has been queued
+    const size_t n = body.size();
+    if (!n || n > kMaxPayload) return 0;
+    std::unique_ptr<char[]> buf(new (std::nothrow) char[n]);
+    if (!buf) return 0;
+    body.rewind();
+    size_t got = 0;
+    while (got < n) {
+      size_t r = body.read((uint8_t*)buf.get() + got, n - got);
+      if (!r) return 0;
+      got += r;
+    }
+
+    int id = esp_mqtt_client_enqueue(cli_, topic.c_str(), buf.get(), (int)n, 1, 0, true);
+    if (id <= 0) return 0;
+
+    xSemaphoreTake(mtx_, portMAX_DELAY);
+    const uint32_t now = millis();
+    for (auto it = slots_.begin(); it != slots_.end(); ) {   // acks nobody collected
+      if (it->second.code && now - it->second.at > kStaleMs) it = slots_.erase(it);
+      else ++it;
+    }
+    slots_.emplace(id, Slot{0, now});        // keeps an ack that arrived first
+    xSemaphoreGive(mtx_);
+    return (uint32_t)id;
+  }
+
+  bool collect(uint32_t ticket, uint32_t wait_ms, int& code, std::string& resp) override {
+    resp.clear();
+    const uint32_t t0 = millis();
+    for (;;) {
+      xSemaphoreTake(mtx_, portMAX_DELAY);
+      auto it = slots_.find((int)ticket);
+      int c = (it == slots_.end()) ? -1 : it->second.code;
+      if (c) { if (it != slots_.end()) slots_.erase(it); }
+      xSemaphoreGive(mtx_);
+      if (c) { code = c; return true; }
+
+      reapLost();
+      uint32_t el = millis() - t0;
+      if (el >= wait_ms) return false;
+      uint32_t w = wait_ms - el;
+      xSemaphoreTake(evt_, pdMS_TO_TICKS(w < kPollMs ? w : kPollMs));
+    }
+  }
+
+  void forget(uint32_t ticket) override {
+    xSemaphoreTake(mtx_, portMAX_DELAY);
+    slots_.erase((int)ticket);
+    xSemaphoreGive(mtx_);
+  }
+
+  bool postBody(const std::string& url, BodySource& body,
+                int& code, std::string& resp,
+                const std::string& apiKey = std::string(),
+                const char* contentType = "application/json") override
+  {
+    code = -1;
+    uint32_t t = submit(url, body, apiKey, contentType);
+    if (!t) return false;
+    const uint32_t limit = ackTimeoutMs(url), t0 = millis();
+    while (!collect(t, kPollMs, code, resp)) {
+      if (limit && millis() - t0 >= limit) { forget(t); code = -1; return false; }
+    }
+    return code > 0;
+  }
+
+  // IDF 4 cannot ask the outbox what it holds: waiting out its expiry makes
+  // a resend safe, unless the link was down meanwhile (nothing expires then)
+  uint32_t ackTimeoutMs(const std::string& url) const override {
+    if (!isMqttUrl(url)) return NetClient::ackTimeoutMs(url);
+#if ESP_IDF_VERSION_MAJOR >= 5
+    return 0;
+#else
+    return kOutboxExpiryMs + kAckMarginMs;
+#endif
+  }
+
+  bool postJson(const std::string& url, const std::string& json,
+                int& code, std::string& resp,
+                const std::string& apiKey = std::string()) override
+  {
+    StringBody body(json);
+    return postBody(url, body, code, resp, apiKey, "application/json");
+  }
+};
+
+NetClient* makeNetClientMqtt(){ return new NetClientMqtt(); }
+
+// Scheme router: HTTPS stays the default, MQTT is created on first use so
+// its task and buffers only exist when a mqtt:// endpoint is configured.
+class NetClientAuto : public NetClient {
+  NetClient* https_ = nullptr;
+  NetClient* mqtt_  = nullptr;
+  NetClient* last_  = nullptr;
+
+  static bool isMqttUrl(const std::string& u){
+    return u.rfind("mqtt://", 0) == 0 || u.rfind("mqtts://", 0) == 0;
+  }
+  NetClient& pick(const std::string& url){
+    if (isMqttUrl(url)) { if (!mqtt_) mqtt_ = makeNetClientMqtt(); last_ = mqtt_; }
+    else                { if (!https_) https_ = makeNetClientHttps(); last_ = https_; }
+    return *last_;
+  }
+public:
+  bool postJson(const std::string& url, const std::string& json, int& code,
+                std::string& resp, const std::string& apiKey = std::string()) override {
+    return pick(url).postJson(url, json, code, resp, apiKey);
+  }
+  bool postBody(const std::string& url, BodySource& body, int& code, std::string& resp,
+                const std::string& apiKey = std::string(),
+                const char* contentType = "application/json") override {
+    return pick(url).postBody(url, body, code, resp, apiKey, contentType);
+  }
+  uint32_t retryAfterMs() const override { return last_ ? last_->retryAfterMs() : 0; }
+  NetTiming lastTiming() const override { return last_ ? last_->lastTiming() : NetTiming(); }
+  void prewarm(const std::string& url) override { if (!isMqttUrl(url)) pick(url).prewarm(url); }
+  uint8_t  window(const std::string& url) const override { return isMqttUrl(url) ? kMqttWindow : 1; }
+  uint32_t submit(const std::string& url, BodySource& body,
+                  const std::string& apiKey, const char* contentType) override {
+    return pick(url).submit(url, body, apiKey, contentType);
+  }
+  // tickets only come from the MQTT client
+  bool collect(uint32_t ticket, uint32_t wait_ms, int& code, std::string& resp) override {
+    if (!mqtt_) { code = -1; resp.clear(); return true; }
+    return mqtt_->collect(ticket, wait_ms, code, resp);
+  }
+  void forget(uint32_t ticket) override { if (mqtt_) mqtt_->forget(ticket); }
+  uint32_t ackTimeoutMs(const std::string& url) const override {
+    const NetClient* n = isMqttUrl(url) ? mqtt_ : https_;
+    return n ? n->ackTimeoutMs(url) : NetClient::ackTimeoutMs(url);
+  }
+};
+
+NetClient* makeNetClient(){ return new (std::nothrow) NetClientAuto(); }
@@ -5,6 +5,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "spi_lock.h"
+#include "metrics.h"
+#include "spool_gen.h"
 
 class SdFs {
 public:
@@ -21,16 +23,45 @@ public:
   // Expose coarse lock for multi-step operations (RAII recommended where possible)
   virtual void lock() = 0;
   virtual void unlock() = 0;
+  // Preemption point inside a locked section (see spi_yield): call between
+  // SD operations in long loops; open File handles stay valid. True if the
+  // bus was handed over, so other tasks may have changed the card meanwhile.
+  virtual bool yield() = 0;
+};
+
+// Yield point for a walk over the spool directory. While the bus is handed
+// over, ingest, acks or a reset may add, remove or move entries, and a
+// walk that carried on could skip or repeat some. restart() reports that
+// (the spool generation moved during the hand-over); the caller then
+// rewinds and drops what it gathered. After kMaxRestarts the walk stops
+// yielding, so it always completes.
+class SdWalkYield {
+public:
+  explicit SdWalkYield(SdFs& fs) : fs_(fs), gen_(spool_generation()) {}
+  // Call between entries; true: rewind the directory and start over
+  bool restart() {
+    if (restarts_ >= kMaxRestarts || !fs_.yield()) return false;
+    uint32_t g = spool_generation();
+    if (g == gen_) return false;
+    gen_ = g;
+    restarts_++;
+    return true;
+  }
+private:
+  static constexpr uint8_t kMaxRestarts = 2;
+  SdFs&    fs_;
+  uint32_t gen_;
+  uint8_t  restarts_ = 0;
 };
 
 class SdFsImpl : public SdFs {
 public:
-  SdFsImpl(){ mtx_ = xSemaphoreCreateMutex(); }
+  SdFsImpl() = default;
   bool begin(uint8_t csPin, SPIClass& spi) override {
     // Try slower SPI for better signal integrity and explicit mount point
     csPin_ = csPin; spi_ = &spi;
     for (int i=0;i<3 && !mounted_; ++i){
-      spi_lock();
+      spi_lock(SpiClient::SdBulk);
       mounted_ = SD.begin(csPin, spi, (i==0? kSpiHz : 1000000 /*1MHz*/), kMountPoint);
       spi_unlock();
       if (!mounted_) delay(50);
@@ -104,8 +135,16 @@ public:
     if (!f) { onFail(); return false; }
     bool d = f.isDirectory(); f.close(); onOk(); return d;
   }
-  void lock() override { if (mtx_) xSemaphoreTake(mtx_, portMAX_DELAY); spi_lock(); }
-  void unlock() override { spi_unlock(); if (mtx_) xSemaphoreGive(mtx_); }
+  // The SD card is guarded by the SPI bus arbiter alone: holding the bus is
+  // holding the card. Bulk by default; LoRa ingest locks as SdIngest.
+  // Hold time (not the wait for the lock) feeds metrics::sd_op_seconds
+  void lock() override { lock(SpiClient::SdBulk); }
+  void lock(SpiClient c) { spi_lock(c); held_us_ = micros(); }
+  void unlock() override {
+    metrics::sd_op_seconds.observe(micros() - held_us_);
+    spi_unlock();
+  }
+  bool yield() override { return spi_yield(); }
 private:
   static constexpr uint32_t kSpiHz = 4000000; // 4 MHz
   static constexpr const char* kMountPoint = "/sd";
@@ -114,7 +153,7 @@ private:
   int  reattempts_ = 0;
   uint8_t csPin_ = 0;
   SPIClass* spi_ = nullptr;
-  SemaphoreHandle_t mtx_ = nullptr;
+  uint32_t held_us_ = 0;   // written only by the lock holder
   struct LockGuard { SdFsImpl& s; LockGuard(SdFsImpl& s_):s(s_){ s.lock(); } ~LockGuard(){ s.unlock(); } };
   bool ensureMounted(){
     if (mounted_) return true;
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Read-mostly value shared across tasks, RCU style. Readers pin the current
+// immutable version with a few atomic ops: no lock, never blocked, never a
+// half-written string. Writers publish a fresh copy with one pointer swap.
+// A replaced version is retired and freed later, once every reader that could
+// still hold it has let go. There are two slots, each with its reader counter;
+// the epoch picks the current one and each publish flips it. A writer never
+// waits for readers either; what cannot be freed yet is retried on the next
+// publish. The previous version stays in the other slot until it is replaced.
+template <class T>
+class Snapshot {
+public:
+  // Pins one version for as long as it lives; keep it short (one request,
+  // one loop iteration) so retired versions do not pile up
+  class Ref {
+    const T*               p_;
+    std::atomic<uint32_t>* cnt_;
+  public:
+    Ref(const T* p, std::atomic<uint32_t>* c) : p_(p), cnt_(c) {}
+    Ref(Ref&& o) noexcept : p_(o.p_), cnt_(o.cnt_) { o.cnt_ = nullptr; }
+    Ref(const Ref&) = delete;
+    Ref& operator=(const Ref&) = delete;
+    ~Ref() { if (cnt_) cnt_->fetch_sub(1, std::memory_order_release); }
+    const T* operator->() const { return p_; }
+    const T& operator*()  const { return *p_; }
+  };
+
+  Snapshot() { slot_[0] = new T(); }
+  explicit Snapshot(const T& v) { slot_[0] = new T(v); }
+  ~Snapshot() {
+    for (auto& s : slot_) delete s.load();
+    for (auto& r : retired_) delete r.p;
+    vSemaphoreDelete(wmtx_);
+  }
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+  // A reader only ever takes the pointer from the slot it is counted in,
+  // after it is counted, so whatever it gets is retired under its counter.
+  // The epoch re-check only keeps a reader that raced a publish from
+  // pinning the older slot. Counting and the writer's check are seq_cst:
+  // each side must see the other's write (store then load).
+  Ref read() const {
+    for (;;) {
+      uint32_t e = epoch_.load();
+      std::atomic<uint32_t>& c = readers_[e & 1];
+      c.fetch_add(1);
+      if (epoch_.load() == e) return Ref(slot_[e & 1].load(), &c);
+      c.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  void publish(const T& v) { publish(new T(v)); }
+
+  // Takes ownership of next
+  void publish(T* next) {
+    xSemaphoreTake(wmtx_, portMAX_DELAY);
+    uint8_t s = (epoch_.load() + 1) & 1;            // the previous version's slot
+    const T* old = slot_[s].exchange(next);
+    epoch_.fetch_add(1);
+    if (old) retired_.push_back(Retired{old, s});
+    reclaim();
+    xSemaphoreGive(wmtx_);
+  }
+
+  // Number of publishes so far (0 = still the initial value)
+  uint32_t version() const { return epoch_.load(std::memory_order_acquire); }
+
+private:
+  struct Retired { const T* p; uint8_t slot; };
+
+  // A version taken out of a slot can only be held by readers counted on
+  // that slot; once the counter is seen at zero after the swap it is free.
+  // Readers counted later find the new pointer, so they only delay this.
+  void reclaim() {
+    size_t keep = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+      if (readers_[retired_[i].slot].load() == 0) delete retired_[i].p;
+      else retired_[keep++] = retired_[i];
+    }
+    retired_.resize(keep);
+  }
+
+  std::atomic<const T*>          slot_[2] = {};
+  std::atomic<uint32_t>          epoch_{0};
+  mutable std::atomic<uint32_t>  readers_[2] = {};
+  std::vector<Retired>           retired_;            // writer side only
+  SemaphoreHandle_t              wmtx_ = xSemaphoreCreateMutex();
+};
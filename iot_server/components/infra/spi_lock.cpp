@@ -1,11 +1,142 @@
 #include "spi_lock.h"
+#include "metrics.h"
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 
-static SemaphoreHandle_t g_spi_mutex = nullptr;
+static constexpr uint8_t  kClasses      = 3;
+static constexpr uint32_t kHoldBudgetUs = 20000;   // then even same-class waiters get a turn
 
-SemaphoreHandle_t spi_bus_mutex(){
-  if (!g_spi_mutex){
-    g_spi_mutex = xSemaphoreCreateMutex();
+// A blocked client; lives on the waiter's stack until it is handed the bus
+struct SpiWaiter {
+  SpiClient         cls;
+  TaskHandle_t      task;
+  SemaphoreHandle_t wake;
+  StaticSemaphore_t wake_buf;
+  SpiWaiter*        next;
+};
+
+// Guards the state below. Held for bookkeeping only, never across bus I/O.
+// Created on first use, which is SD mount in setup() before other tasks run.
+static SemaphoreHandle_t     s_mtx     = nullptr;
+static bool                  s_busy    = false;
+static SpiClient             s_cls     = SpiClient::SdBulk;
+static TaskHandle_t          s_owner   = nullptr;
+static UBaseType_t           s_base    = 0;        // owner's priority before a boost
+static bool                  s_boosted = false;
+static uint32_t              s_since   = 0;        // micros() at grant
+static SpiWaiter*            s_head[kClasses] = {};
+static SpiWaiter*            s_tail[kClasses] = {};
+static std::atomic<uint8_t>  s_waiting{0};         // bit per class with waiters; read lock-free by spi_yield
+
+static metrics::Histogram* const kWait[kClasses] = {
+  &metrics::spi_wait_radio, &metrics::spi_wait_sd_ingest, &metrics::spi_wait_sd_bulk };
+static metrics::Histogram* const kHold[kClasses] = {
+  &metrics::spi_hold_radio, &metrics::spi_hold_sd_ingest, &metrics::spi_hold_sd_bulk };
+
+static void stateLock(){
+  if (!s_mtx) s_mtx = xSemaphoreCreateMutex();
+  xSemaphoreTake(s_mtx, portMAX_DELAY);
+}
+static void stateUnlock(){ xSemaphoreGive(s_mtx); }
+
+static void grant(SpiClient c, TaskHandle_t t){
+  s_busy  = true;
+  s_cls   = c;
+  s_owner = t;
+  s_since = micros();
+}
+
+// With the state held: lends the owner the priority of its most urgent
+// waiter, if that outranks it. Done on every grant as well as on every new
+// waiter, so the boost follows the bus from one holder to the next.
+static void boostOwner(){
+  UBaseType_t top = 0;
+  for (uint8_t i = 0; i < kClasses; ++i)
+    for (SpiWaiter* w = s_head[i]; w; w = w->next) {
+      UBaseType_t p = uxTaskPriorityGet(w->task);
+      if (p > top) top = p;
+    }
+  UBaseType_t cur = uxTaskPriorityGet(s_owner);
+  if (top <= cur) return;
+  if (!s_boosted) { s_base = cur; s_boosted = true; }
+  vTaskPrioritySet(s_owner, top);
+}
+
+// With the state held: ends the current hold and passes the bus to the
+// first waiter of the best class, or frees it. The caller wakes the
+// returned waiter once the state is released.
+static SpiWaiter* handOff(){
+  kHold[(uint8_t)s_cls]->observe(micros() - s_since);
+  if (s_boosted) { vTaskPrioritySet(s_owner, s_base); s_boosted = false; }
+  for (uint8_t i = 0; i < kClasses; ++i) {
+    SpiWaiter* w = s_head[i];
+    if (!w) continue;
+    s_head[i] = w->next;
+    if (!s_head[i]) { s_tail[i] = nullptr; s_waiting.fetch_and((uint8_t)~(1u << i)); }
+    grant(w->cls, w->task);
+    boostOwner();
+    return w;
+  }
+  s_busy  = false;
+  s_owner = nullptr;
+  return nullptr;
+}
+
+// With the state held and the bus busy: queues the caller, lends the owner
+// its priority if it outranks it, then blocks until handed the bus
+static void waitTurn(SpiClient c){
+  uint32_t t0 = micros();
+  SpiWaiter w;
+  w.cls  = c;
+  w.task = xTaskGetCurrentTaskHandle();
+  w.wake = xSemaphoreCreateBinaryStatic(&w.wake_buf);
+  w.next = nullptr;
+  uint8_t i = (uint8_t)c;
+  if (s_tail[i]) s_tail[i]->next = &w; else s_head[i] = &w;
+  s_tail[i] = &w;
+  s_waiting.fetch_or((uint8_t)(1u << i));
+
+  boostOwner();
+  stateUnlock();
+
+  xSemaphoreTake(w.wake, portMAX_DELAY);
+  vSemaphoreDelete(w.wake);
+  kWait[i]->observe(micros() - t0);
+}
+
+void spi_lock(SpiClient c){
+  stateLock();
+  if (!s_busy) {
+    grant(c, xTaskGetCurrentTaskHandle());
+    stateUnlock();
+    kWait[(uint8_t)c]->observe(0);
+    return;
   }
-  return g_spi_mutex;
+  waitTurn(c);
+}
+
+void spi_unlock(){
+  stateLock();
+  SpiWaiter* next = handOff();
+  stateUnlock();
+  if (next) xSemaphoreGive(next->wake);
 }
 
+bool spi_yield(){
+  uint8_t waiting = s_waiting.load(std::memory_order_relaxed);
+  if (!waiting) return false;
+  // classes above the holder's (lower index) have priority
+  bool above = waiting & ((1u << (uint8_t)s_cls) - 1);
+  if (!above && micros() - s_since < kHoldBudgetUs) return false;
+
+  SpiClient c = s_cls;
+  stateLock();
+  SpiWaiter* next = handOff();
+  if (!next) { grant(c, xTaskGetCurrentTaskHandle()); stateUnlock(); return false; }
+  xSemaphoreGive(next->wake);
+  waitTurn(c);                       // releases the state
+  return true;
+}
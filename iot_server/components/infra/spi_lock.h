@@ -1,9 +1,22 @@
 #pragma once
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include <stdint.h>
 
-// Global SPI bus mutex for peripherals sharing VSPI
-SemaphoreHandle_t spi_bus_mutex();
-inline void spi_lock(){ xSemaphoreTake(spi_bus_mutex(), portMAX_DELAY); }
-inline void spi_unlock(){ xSemaphoreGive(spi_bus_mutex()); }
+// Arbiter for the SPI bus shared by the LoRa radio and the SD card (VSPI).
+// Waiters are served by class, highest first, FIFO within a class; the
+// holder is raised to the priority of its most urgent waiter meanwhile.
+// Long SD sections call spi_yield() between operations, so a radio read
+// waits for at most the SD operation in flight, not a whole directory walk.
+enum class SpiClient : uint8_t {
+  Radio,      // LoRa FIFO reads: the packet is lost if the next one lands first
+  SdIngest,   // spooling a received record
+  SdBulk,     // directory walks, uploads, HTTP reads, config
+};
 
+void spi_lock(SpiClient c);
+void spi_unlock();
+
+// Preemption point for the holder: if a higher class is waiting, or the
+// bus has been held past its budget while anyone waits, hands the bus over
+// and takes it back in turn. Only call between complete bus operations.
+// True if the bus was given away.
+bool spi_yield();
@@ -0,0 +1,7 @@
+#include "spool_gen.h"
+#include <atomic>
+
+static std::atomic<uint32_t> g_spool_gen{1};
+
+uint32_t spool_generation(){ return g_spool_gen.load(std::memory_order_acquire); }
+void     spool_touch(){ g_spool_gen.fetch_add(1, std::memory_order_acq_rel); }
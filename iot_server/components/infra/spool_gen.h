@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+// Spool generation: bumped after every change to the /spool directory
+// (ingest, upload ack, quarantine, reset). Anything derived from a spool
+// scan stays valid for as long as the generation it was taken at is current.
+uint32_t spool_generation();
+void     spool_touch();
@@ -0,0 +1,145 @@
+#include "config_service.h"
+#include <LittleFS.h>
+
+static void pickStr(JsonDocument& d, const char* key, const char* legacy, String& out){
+  if (d[key].is<const char*>())                     out = (const char*)d[key];
+  else if (legacy && d[legacy].is<const char*>())   out = (const char*)d[legacy];
+}
+
+void ConfigService::fromJson(JsonDocument& d, AppConfig& c){
+  pickStr(d, "auth_user",         "user",     c.auth_user);
+  pickStr(d, "auth_password",     "pass",     c.auth_password);
+  pickStr(d, "wifi_ap_ssid",      nullptr,    c.wifi_ap_ssid);
+  pickStr(d, "wifi_ap_password",  nullptr,    c.wifi_ap_password);
+  pickStr(d, "wifi_sta_ssid",     "ssid",     c.wifi_sta_ssid);
+  pickStr(d, "wifi_sta_password", "password", c.wifi_sta_password);
+  pickStr(d, "api_url",           "apiUrl",   c.api_url);
+  if (d["upload_interval"].is<uint32_t>())  c.upload_interval = d["upload_interval"];
+  else if (d["intervalMs"].is<uint32_t>())  c.upload_interval = d["intervalMs"];
+}
+
+void ConfigService::toJson(const AppConfig& c, JsonDocument& out){
+  out["auth_user"]         = c.auth_user;
+  out["auth_password"]     = c.auth_password;
+  out["wifi_ap_ssid"]      = c.wifi_ap_ssid;
+  out["wifi_ap_password"]  = c.wifi_ap_password;
+  out["wifi_sta_ssid"]     = c.wifi_sta_ssid;
+  out["wifi_sta_password"] = c.wifi_sta_password;
+  out["api_url"]           = c.api_url;
+  out["upload_interval"]   = c.upload_interval;
+}
+
+uint32_t ConfigService::diff(const AppConfig& a, const AppConfig& b){
+  uint32_t m = 0;
+  if (a.auth_user != b.auth_user || a.auth_password != b.auth_password)                 m |= ChangedAuth;
+  if (a.wifi_ap_ssid != b.wifi_ap_ssid || a.wifi_ap_password != b.wifi_ap_password)     m |= ChangedAp;
+  if (a.wifi_sta_ssid != b.wifi_sta_ssid || a.wifi_sta_password != b.wifi_sta_password) m |= ChangedSta;
+  if (a.api_url != b.api_url || a.upload_interval != b.upload_interval)                 m |= ChangedApi;
+  return m;
+}
+
+// FAT's rename does not replace an existing file, so the old copy is removed
+// first; if power goes in between, load() picks up the temp file instead
+bool ConfigService::persist(const String& body){
+  if (!sd_.isMounted()) return false;
+  if (!sd_.writeAll(kTmpPath, body)) return false;
+  if (sd_.exists(kPath) && !sd_.remove(kPath)) return false;
+  return sd_.rename(kTmpPath, kPath);
+}
+
+void ConfigService::load(){
+  AppConfig c;
+  String raw;
+  bool loaded = false, hasAuth = false, fromTmp = false;
+
+  if (sd_.isMounted()) {
+    const char* path = sd_.exists(kPath) ? kPath : (sd_.exists(kTmpPath) ? kTmpPath : nullptr);
+    fromTmp = (path == kTmpPath);
+    if (path && sd_.readAll(path, raw)) {
+      JsonDocument d;
+      auto err = deserializeJson(d, raw);
+      if (!err) {
+        fromJson(d, c);
+        loaded  = true;
+        hasAuth = d["auth_user"].is<const char*>() || d["user"].is<const char*>();
+        Serial.printf("[CFG] Loaded from SD:%s\n", path);
+      } else {
+        Serial.printf("[CFG] SD:%s parse error: %s\n", path, err.c_str());
+      }
+    } else {
+      Serial.println("[CFG] SD:/config.json missing");
+    }
+  } else {
+    Serial.println("[CFG] SD not mounted");
+  }
+
+  // LittleFS:/config.json: the whole config when SD has none, and the
+  // login pair that older firmware kept only there
+  if ((!loaded || !hasAuth) && LittleFS.exists(kPath)) {
+    File f = LittleFS.open(kPath, "r");
+    JsonDocument d;
+    if (f && !deserializeJson(d, f)) {
+      if (!loaded) {
+        fromJson(d, c);
+        loaded = true;
+        Serial.println("[CFG] Loaded from LittleFS:/config.json (fallback)");
+      } else {
+        pickStr(d, "auth_user",     "user", c.auth_user);
+        pickStr(d, "auth_password", "pass", c.auth_password);
+      }
+    }
+    if (f) f.close();
+  }
+  cfg_.publish(c);
+
+  // Normalize (new keys, defaults filled) once; an unchanged file is not rewritten
+  JsonDocument n;
+  toJson(c, n);
+  String body;
+  serializeJson(n, body);
+  if (sd_.isMounted() && body != raw) {
+    bool ok = persist(body);
+    Serial.printf("[CFG] %s SD:/config.json%s\n", raw.length() ? "Normalized" : "Created",
+                  ok ? "" : " FAILED");
+  } else if (fromTmp) {
+    // persist() was cut off between remove and rename: finish it
+    bool ok = sd_.rename(kTmpPath, kPath);
+    Serial.printf("[CFG] Recovered SD:/config.json from the temp file%s\n", ok ? "" : " FAILED");
+  }
+
+  Serial.printf("[CFG] AP SSID='%s' PASS='%s'\n", c.wifi_ap_ssid.c_str(), c.wifi_ap_password.c_str());
+  Serial.printf("[CFG] STA SSID='%s' PASS='%s'\n", c.wifi_sta_ssid.c_str(), c.wifi_sta_password.c_str());
+  Serial.printf("[CFG] API URL='%s' INTERVAL=%u\n", c.api_url.c_str(), (unsigned)c.upload_interval);
+}
+
+bool ConfigService::update(const std::function<void(AppConfig&)>& edit, uint32_t* changed){
+  xSemaphoreTake(wmtx_, portMAX_DELAY);
+  AppConfig next;
+  uint32_t mask;
+  {
+    auto cur = cfg_.read();
+    next = *cur;
+    edit(next);
+    mask = diff(*cur, next);
+  }
+  bool ok = true;
+  if (mask) {
+    cfg_.publish(next);
+    JsonDocument d;
+    toJson(next, d);
+    String body;
+    serializeJson(d, body);
+    ok = persist(body);
+    if (!ok) Serial.println("[CFG] WARN: SD write failed; change kept in RAM only");
+  }
+  xSemaphoreGive(wmtx_);
+
+  if (changed) *changed = mask;
+  if (mask) for (auto& fn : listeners_) fn(next, mask);
+  return ok;
+}
+
+bool ConfigService::checkLogin(const String& user, const String& pass) const {
+  auto c = get();
+  return user == c->auth_user && pass == c->auth_password;
+}
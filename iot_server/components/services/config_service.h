@@ -0,0 +1,71 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "infra/sd_fs.h"
+#include "infra/snapshot.h"
+
+// Everything that used to live in SD:/config.json (plus the auth pair that
+// was kept in LittleFS:/config.json), typed and with the defaults applied
+struct AppConfig {
+  String   auth_user         = "admin";
+  String   auth_password     = "admin";
+  String   wifi_ap_ssid      = "Device-Portal";
+  String   wifi_ap_password  = "12345678";
+  String   wifi_sta_ssid;
+  String   wifi_sta_password;
+  String   api_url;
+  uint32_t upload_interval   = 15000;
+};
+
+// Loaded once at boot; every read after that is served from RAM (a pinned
+// snapshot, no lock, no SD). Changes are written through to SD only when a
+// value actually differs, via a temp file + rename, and then announced to
+// the subscribers on the task that made the change.
+class ConfigService {
+public:
+  // Groups reported to subscribers / returned by update()
+  enum Changed : uint32_t {
+    ChangedAuth = 1u << 0,
+    ChangedAp   = 1u << 1,
+    ChangedSta  = 1u << 2,
+    ChangedApi  = 1u << 3,   // api_url / upload_interval
+  };
+  using Listener = std::function<void(const AppConfig&, uint32_t changed)>;
+
+  explicit ConfigService(SdFsImpl& sd) : sd_(sd) {}
+
+  // SD:/config.json, else the LittleFS copy (migrated to SD), else defaults.
+  // Legacy keys (user, pass, ssid, password, apiUrl, intervalMs) are mapped.
+  void load();
+
+  Snapshot<AppConfig>::Ref get() const { return cfg_.read(); }
+
+  // Applies edit to a copy of the current config. Nothing is written or
+  // announced when it changed nothing. Returns false only when the SD write
+  // failed; the new values are in effect (RAM) either way.
+  bool update(const std::function<void(AppConfig&)>& edit, uint32_t* changed = nullptr);
+
+  // Call during setup, before other tasks can update()
+  void subscribe(Listener fn) { listeners_.push_back(std::move(fn)); }
+
+  bool checkLogin(const String& user, const String& pass) const;
+
+  static void toJson(const AppConfig& c, JsonDocument& out);
+
+private:
+  static constexpr const char* kPath    = "/config.json";
+  static constexpr const char* kTmpPath = "/config.json.tmp";
+
+  static void     fromJson(JsonDocument& src, AppConfig& c);   // missing keys keep c's value
+  static uint32_t diff(const AppConfig& a, const AppConfig& b);
+  bool            persist(const String& body);
+
+  SdFsImpl&             sd_;
+  Snapshot<AppConfig>   cfg_;
+  std::vector<Listener> listeners_;
+  SemaphoreHandle_t     wmtx_ = xSemaphoreCreateMutex();   // update() is read-modify-write
+};
@@ -3,6 +3,8 @@
 #include <Arduino.h>
 #include <SD.h>
 #include "infra/sd_fs.h"
+#include "infra/metrics.h"
+#include "infra/spool_gen.h"
 #include <cctype>
 #include <time.h>
 
@@ -66,66 +68,81 @@ bool LoraRxService::begin() {
   if (!queue_) queue_ = xQueueCreate(16, sizeof(Item*));
   if (!queue_) return false;
   if (!lora_.begin()) return false;
+  if (!ingest_task_ &&
+      xTaskCreate([](void* self){ static_cast<LoraRxService*>(self)->ingestLoop(); },
+                  "lora_ing", 4096, this, 1, &ingest_task_) != pdPASS) {
+    ingest_task_ = nullptr;
+    Serial.println("[LoRa] ERROR: failed to create ingest task (out of memory)");
+    return false;
+  }
 
   lora_.onPacket([this](const std::string& p){
     std::string scanner, rfid;
     if (!parseAndValidate(p, scanner, rfid)) {
+      metrics::lora_rx_invalid.inc();
       Serial.printf("[LoRa] Ignored invalid payload '%s'\n", p.c_str());
       return;
     }
     Item* it = new Item{ scanner, rfid };
     if (xQueueSendToBack(queue_, &it, 0) != pdPASS){
+      metrics::lora_rx_dropped.inc();
       delete it; Serial.println("[LoRa] queue full; dropping packet");
+      return;
     }
+    metrics::lora_rx_packets.inc();
+    metrics::lora_rx_queue_max.setMax((int32_t)uxQueueMessagesWaiting(queue_));
   });
   return true;
 }
 
+// Radio only: a poll never waits behind a spool write, just for the bus
 void LoraRxService::taskLoop() {
   for(;;) {
     lora_.pollOnce();
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
 
-    for (int i = 0; i < 4; i++) {
-      Item* it = nullptr;
-      if (xQueueReceive(queue_, &it, 0) != pdPASS) break;
-      if (!it) continue;
+void LoraRxService::ingestLoop() {
+  for(;;) {
+    Item* it = nullptr;
+    if (xQueueReceive(queue_, &it, portMAX_DELAY) != pdPASS || !it) continue;
 
-      String iso, ts14; const char* src = "?";
-      makeTimestamps(rtc_, iso, ts14, &src);
+    String iso, ts14; const char* src = "?";
+    makeTimestamps(rtc_, iso, ts14, &src);
 
-      domain::LogEntry e;
-      e.scanner_id = it->scanner;
-      e.rfid       = it->rfid;
-      e.ts_iso     = iso.c_str();
-      e.sent       = false;
+    domain::LogEntry e;
+    e.scanner_id = it->scanner;
+    e.rfid       = it->rfid;
+    e.ts_iso     = iso.c_str();
+    e.sent       = false;
 
-      Serial.printf("[LoRa] RX scanner=%s rfid=%s ts=%s (src=%s)\n",
-        e.scanner_id.c_str(), e.rfid.c_str(), e.ts_iso.c_str(), src);
+    Serial.printf("[LoRa] RX scanner=%s rfid=%s ts=%s (src=%s)\n",
+      e.scanner_id.c_str(), e.rfid.c_str(), e.ts_iso.c_str(), src);
 
-      repo_.append(e);
+    repo_.append(e);
 
-      SDfs.lock();
-      do {
-        if (!SDfs.isMounted()) { Serial.println("[LoRa] SD not mounted; skip spool"); break; }
-        if (!SD.exists(kSpoolDir)) SD.mkdir(kSpoolDir);
+    SDfs.lock(SpiClient::SdIngest);
+    do {
+      if (!SDfs.isMounted()) { Serial.println("[LoRa] SD not mounted; skip spool"); break; }
+      if (!SD.exists(kSpoolDir)) SD.mkdir(kSpoolDir);
 
-        String fname = String(kSpoolDir) + "/LOG." + e.rfid.c_str() + "." + ts14 + "." + e.scanner_id.c_str();
-        if (SD.exists(fname)) {               // very rare same-second collision
-          for (uint32_t n=2; n<1000; ++n) {
-            String alt = fname + "." + String(n);
-            if (!SD.exists(alt)) { fname = alt; break; }
-          }
+      String fname = String(kSpoolDir) + "/LOG." + e.rfid.c_str() + "." + ts14 + "." + e.scanner_id.c_str();
+      if (SD.exists(fname)) {               // very rare same-second collision
+        for (uint32_t n=2; n<1000; ++n) {
+          String alt = fname + "." + String(n);
+          if (!SD.exists(alt)) { fname = alt; break; }
         }
-        File f = SD.open(fname, FILE_WRITE);
-        if (!f) { Serial.printf("[LoRa] Spool create failed: %s\n", fname.c_str()); break; }
-        f.close();
-        Serial.printf("[LoRa] Spooled %s\n", fname.c_str());
-      } while(false);
-      SDfs.unlock();
-
-      delete it;
-    }
-
-    vTaskDelay(pdMS_TO_TICKS(10));
+      }
+      File f = SD.open(fname, FILE_WRITE);
+      if (!f) { Serial.printf("[LoRa] Spool create failed: %s\n", fname.c_str()); break; }
+      f.close();
+      spool_touch();
+      Serial.printf("[LoRa] Spooled %s\n", fname.c_str());
+    } while(false);
+    SDfs.unlock();
+    if (on_ingest_) on_ingest_(e);
+
+    delete it;
   }
 }
@@ -5,15 +5,25 @@
 #include "infra/rtc_clock.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
+#include <functional>
 
 class LoraRxService {
   LoRaPort& lora_;
   LogRepo&  repo_;
   RtcClock& rtc_;
   struct Item { std::string scanner; std::string rfid; };
-  QueueHandle_t queue_ = nullptr;
+  QueueHandle_t queue_ = nullptr;       // radio task -> ingest task
+  TaskHandle_t  ingest_task_ = nullptr;  // stamps and spools queued records
+  std::function<void(const domain::LogEntry&)> on_ingest_;
 public:
   LoraRxService(LoRaPort& l, LogRepo& r, RtcClock& t) : lora_(l), repo_(r), rtc_(t) {}
+  // Starts the radio and the ingest task
   bool begin();
+  // Called after each record is stored (repo + spool), from the ingest task
+  void onIngest(std::function<void(const domain::LogEntry&)> cb) { on_ingest_ = std::move(cb); }
+  // Radio polling loop; run on its own task after begin()
   void taskLoop();
+private:
+  void ingestLoop();
 };
@@ -0,0 +1,73 @@
+#include "upload_codec.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace upload_codec {
+
+// MessagePack pieces (big-endian, shortest form)
+static size_t mpStr(uint8_t* o, const char* s, size_t n){
+  size_t k = 0;
+  if (n < 32)       o[k++] = 0xa0 | (uint8_t)n;
+  else { if (n > 255) n = 255; o[k++] = 0xd9; o[k++] = (uint8_t)n; }
+  memcpy(o + k, s, n);
+  return k + n;
+}
+static size_t mpArrayHdr(uint8_t* o, size_t n){
+  if (n < 16)     { o[0] = 0x90 | (uint8_t)n; return 1; }
+  if (n < 65536)  { o[0] = 0xdc; o[1] = n >> 8; o[2] = n; return 3; }
+  o[0] = 0xdd; o[1] = n >> 24; o[2] = n >> 16; o[3] = n >> 8; o[4] = n; return 5;
+}
+// Hex UID -> raw bytes; 0 if it is not an even-length hex string that fits
+static size_t hexToBytes(const char* hex, uint8_t* out, size_t cap){
+  size_t n = strlen(hex);
+  if (!n || (n & 1) || n / 2 > cap) return 0;
+  auto nib = [](char c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  for (size_t i = 0; i < n; i += 2) {
+    int hi = nib(hex[i]), lo = nib(hex[i + 1]);
+    if (hi < 0 || lo < 0) return 0;
+    out[i / 2] = (uint8_t)((hi << 4) | lo);
+  }
+  return n / 2;
+}
+
+size_t jsonHead(char* out, size_t cap){ return snprintf(out, cap, "{\"data\":["); }
+size_t jsonTail(char* out, size_t cap){ return snprintf(out, cap, "]}"); }
+
+size_t jsonRecord(char* out, size_t cap, size_t index, const Record& r){
+  const char* sep = index ? "," : "";
+  if (!r.id) return snprintf(out, cap, "%s{\"rfid\":\"%s\",\"timestamp\":\"%s\"}", sep, r.rfid, r.ts);
+  return snprintf(out, cap, "%s{\"id\":\"%s\",\"rfid\":\"%s\",\"timestamp\":\"%s\"}", sep, r.id, r.rfid, r.ts);
+}
+
+size_t mpHead(uint8_t* o, size_t count){
+  o[0] = 0x81;
+  size_t k = 1 + mpStr(o + 1, "data", 4);
+  return k + mpArrayHdr(o + k, count);
+}
+
+// At most 1 + 3+97 + 5+66 + 3+5 bytes
+size_t mpRecord(uint8_t* o, const Record& r){
+  size_t k = 0;
+  o[k++] = r.id ? 0x83 : 0x82;
+  if (r.id) {
+    k += mpStr(o + k, "id", 2);
+    k += mpStr(o + k, r.id, strlen(r.id));
+  }
+  uint8_t uid[32];
+  size_t ul = hexToBytes(r.rfid, uid, sizeof(uid));
+  k += mpStr(o + k, "rfid", 4);
+  if (ul) { o[k++] = 0xc4; o[k++] = (uint8_t)ul; memcpy(o + k, uid, ul); k += ul; }
+  else    { size_t rl = strlen(r.rfid); k += mpStr(o + k, r.rfid, rl > 64 ? 64 : rl); }
+  k += mpStr(o + k, "ts", 2);
+  int64_t t = r.epoch;
+  if (t < 0 || t > 0xFFFFFFFFLL) { o[k++] = 0xc0; }          // nil: timestamp unknown
+  else { o[k++] = 0xce; o[k++] = t >> 24; o[k++] = t >> 16; o[k++] = t >> 8; o[k++] = t; }
+  return k;
+}
+
+} // namespace upload_codec
@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire encoding of upload bodies, one piece at a time, so BatchBody can
+// stream a batch through a small buffer. Plain C++ (no Arduino), which keeps
+// it testable on the host (test/test_upload_codec).
+//
+//   JSON:    {"data":[{"id":"..","rfid":"..","timestamp":".."}, ...]}
+//   MsgPack: {"data":[{"id":str,"rfid":bin,"ts":uint32|nil}, ...]}
+//
+// Fields are written verbatim: the caller guarantees they need no JSON
+// escaping and fit the limits below (see prepareBatch).
+namespace upload_codec {
+
+struct Record {
+  const char* id;      // nullptr: no "id" field
+  const char* rfid;    // hex UID; sent as raw bytes in MsgPack when it parses
+  const char* ts;      // "YYYY-MM-DD HH:MM:SS" (JSON)
+  int64_t     epoch;   // seconds (MsgPack); outside 0..2^32-1 = unknown, sent as nil
+};
+
+static constexpr size_t kMaxId   = 95;
+static constexpr size_t kMaxRfid = 32;
+static constexpr size_t kMaxTs   = 19;
+// Largest single piece either encoding produces for fields within the limits
+static constexpr size_t kPieceMax = 192;
+
+// Each returns the piece length; JSON pieces are NUL-terminated within cap
+size_t jsonHead(char* out, size_t cap);
+size_t jsonRecord(char* out, size_t cap, size_t index, const Record& r);
+size_t jsonTail(char* out, size_t cap);
+
+size_t mpHead(uint8_t* out, size_t count);
+size_t mpRecord(uint8_t* out, const Record& r);   // MsgPack has no tail
+
+} // namespace upload_codec
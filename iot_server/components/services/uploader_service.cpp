@@ -4,11 +4,17 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <SD.h>
+#include <ArduinoJson.h>
+#include "infra/metrics.h"
+#include "infra/spool_gen.h"
+#include "upload_codec.h"
 
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <deque>
 #include <string>
+#include <time.h>
 
 // ─────────────────────────────────────────────────────────────
 // Task trampoline
@@ -16,6 +22,9 @@
 static void uploader_task_entry(void* arg){
   static_cast<UploaderService*>(arg)->taskLoop();
 }
+static void uploader_sd_task_entry(void* arg){
+  static_cast<UploaderService*>(arg)->sdStageLoop();
+}
 
 // ─────────────────────────────────────────────────────────────
 // Lifecycle
@@ -24,8 +33,76 @@ void UploaderService::armWarmup(uint32_t ms){
   warmup_deadline_ms_ = millis() + ms;
 }
 
+// Wakes the network task (reason bits) and the SD stage. Task notifications
+// latch, so a wake that races with the decision to sleep is not lost.
+void UploaderService::wake(uint32_t why){
+  if (task_) xTaskNotify(task_, why, eSetBits);
+  if (sd_task_) xTaskNotifyGive(sd_task_);
+}
+
+// Returns a finished batch to the SD stage for its acks. Never called with
+// settle_mtx_ held: ackBatch takes it on the SD stage.
+void UploaderService::handBack(Batch* b){
+  xQueueSend(done_q_, &b, portMAX_DELAY);
+  xTaskNotifyGive(sd_task_);
+}
+
+// Caller holds settle_mtx_; readers get the copy, never the working one
+void UploaderService::publishDebug(){
+  debug_snap_.publish(debug_);
+}
+
+void UploaderService::noteWorkers(){
+  xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+  debug_.workers = busy_workers_.load();
+  publishDebug();
+  xSemaphoreGive(settle_mtx_);
+}
+
+// Network task: sleep until woken or ms elapsed, then apply the reasons
+void UploaderService::waitWake(uint32_t ms){
+  if (debug_.in_flight && ms > 50) ms = 50;       // windowed acks to collect
+  uint32_t bits = 0;
+  xTaskNotifyWait(0, 0xFFFFFFFFu, &bits, ms == kForever ? portMAX_DELAY : pdMS_TO_TICKS(ms));
+  if (!bits) return;
+  if (bits & (WakeStart | WakeConfig)) { idle_ = false; next_due_ = 0; }
+  if ((bits & WakeIngest) && idle_) {
+    // first record after idle: give a burst a moment to coalesce
+    idle_ = false;
+    next_due_ = millis() + cfg()->ingest_coalesce_ms;
+  }
+  if (bits & WakeWifi) idle_ = false;
+  if (sd_task_) xTaskNotifyGive(sd_task_);      // SD stage re-reads next_due_
+}
+
 void UploaderService::ensureTask(){
   if (task_) return;
+  if (!ready_q_) ready_q_ = xQueueCreate(kMaxWindow + 1, sizeof(Batch*));
+  if (!done_q_)  done_q_  = xQueueCreate(kMaxWindow + 2, sizeof(Batch*));
+  if (!ready_q_ || !done_q_){
+    enabled_ = false;
+    Serial.println("[UP] ERROR: failed to create upload queues (out of memory)");
+    return;
+  }
+  if (!sd_task_){
+    BaseType_t rc = xTaskCreatePinnedToCore(
+      uploader_sd_task_entry,
+      "upl_sd",
+      6144,     // directory walk + acks
+      this,
+      1,
+      &sd_task_,
+      1);
+    if (rc != pdPASS){
+      sd_task_ = nullptr;
+      enabled_ = false;
+      Serial.println("[UP] ERROR: failed to create upload SD task (out of memory)");
+      return;
+    }
+  }
+  WiFi.onEvent([this](WiFiEvent_t, WiFiEventInfo_t){ wake(WakeWifi); },
+               ARDUINO_EVENT_WIFI_STA_GOT_IP);
+
   const uint32_t stackWords = 6144; // ~24KB
   BaseType_t rc = xTaskCreatePinnedToCore(
     uploader_task_entry,
@@ -85,28 +162,65 @@ String UploaderService::baseName(const char* p){
   return (k >= 0) ? s.substring(k+1) : s;
 }
 
-bool UploaderService::spoolListGrouped(size_t max_total,
-                                       std::map<String, std::vector<SpoolItem>>& byScanner)
+// Local "YYYY-MM-DD HH:MM:SS" -> epoch seconds; -1 if malformed
+static int64_t isoToEpoch(const char* iso){
+  int Y, M, D, h, m, sec;
+  if (!iso || strlen(iso) != 19 ||
+      sscanf(iso, "%4d-%2d-%2d %2d:%2d:%2d", &Y, &M, &D, &h, &m, &sec) != 6) return -1;
+  struct tm tm{};
+  tm.tm_year = Y - 1900;
+  tm.tm_mon  = M - 1;
+  tm.tm_mday = D;
+  tm.tm_hour = h;
+  tm.tm_min  = m;
+  tm.tm_sec  = sec;
+  tm.tm_isdst = -1;
+  time_t t = mktime(&tm);
+  return (t > 0) ? (int64_t)t : -1;
+}
+
+// Age in seconds of an ISO "YYYY-MM-DD HH:MM:SS" local timestamp; -1 if unknown
+static int32_t isoAgeSeconds(const String& iso){
+  time_t now = time(nullptr);
+  if (now < 1700000000) return -1;   // clock not set yet
+  int64_t t = isoToEpoch(iso.c_str());
+  if (t < 0) return -1;
+  return (now > t) ? (int32_t)(now - t) : 0;
+}
+
+static bool spoolOlder(const UploaderService::SpoolItem& a, const UploaderService::SpoolItem& b){
+  int c = a.ts.compareTo(b.ts);
+  if (c == 0) c = a.rfid.compareTo(b.rfid);
+  return c < 0;
+}
+
+bool UploaderService::spoolListGrouped(size_t per_scanner,
+                                       std::map<String, std::vector<SpoolItem>>& byScanner,
+                                       std::map<String, ScannerStat>& stats)
 {
+  auto uc = cfg();
   byScanner.clear();
+  stats.clear();
   if (!sdfs_) return false;
-  if (max_total == 0) max_total = 50;
+  if (per_scanner == 0) per_scanner = 50;
 
   sdfs_->lock();
 
   // Ensure dir exists (LoRa should create it, but make it robust)
-  if (!SD.exists(cfg_.spool_dir.c_str())) {
-    SD.mkdir(cfg_.spool_dir.c_str());
+  if (!SD.exists(uc->spool_dir.c_str())) {
+    SD.mkdir(uc->spool_dir.c_str());
   }
 
-  File dir = SD.open(cfg_.spool_dir.c_str());
+  File dir = SD.open(uc->spool_dir.c_str());
   if (!dir || !dir.isDirectory()) {
     if (dir) dir.close();
     sdfs_->unlock();
     return true; // treat as empty rather than error
   }
 
-  size_t collected = 0;
+  // Walk the whole directory so every scanner is seen; memory stays bounded
+  // because each group is trimmed back to its per_scanner oldest items.
+  SdWalkYield walk(*sdfs_);
   for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
     if (f.isDirectory()) { f.close(); continue; }
 
@@ -114,22 +228,37 @@ bool UploaderService::spoolListGrouped(size_t max_total,
     String base = baseName(full.c_str());
     f.close();
 
+    if (walk.restart()) {                   // radio and ingest go first
+      byScanner.clear();
+      stats.clear();
+      dir.rewindDirectory();
+      continue;
+    }
     if (!base.startsWith("LOG.")) continue;
 
     String rfid, tsIso, scanner;
     if (!parseSpoolBaseNew(base, rfid, tsIso, scanner)) continue;
 
+    String path = String(uc->spool_dir.c_str()) + "/" + base;
+    if (inflight_.count(path)) continue;    // already on its way to the server
+
+    ScannerStat& st = stats[scanner];
+    if (!st.oldest_ts.length() || (tsIso.length() && tsIso.compareTo(st.oldest_ts) < 0))
+      st.oldest_ts = tsIso;
+    st.pending++;
+
     SpoolItem it;
-    it.path    = String(cfg_.spool_dir.c_str()) + "/" + base;
+    it.path    = path;
     it.rfid    = rfid;
     it.scanner = scanner;
     it.ts      = tsIso; // extracted from filename
 
-    byScanner[scanner].push_back(std::move(it));
-
-    ++collected;
-    if (collected >= max_total) break;
-    if ((collected & 0x3F) == 0) vTaskDelay(1); // yield while scanning
+    auto& vec = byScanner[scanner];
+    vec.push_back(std::move(it));
+    if (vec.size() >= per_scanner * 2) {
+      std::sort(vec.begin(), vec.end(), spoolOlder);
+      vec.resize(per_scanner);
+    }
   }
 
   dir.close();
@@ -138,12 +267,13 @@ bool UploaderService::spoolListGrouped(size_t max_total,
   // Stable order inside each scanner group (by ts then RFID, fallback to RFID)
   for (auto& kv : byScanner) {
     auto& vec = kv.second;
-    std::sort(vec.begin(), vec.end(),
-      [](const SpoolItem& a, const SpoolItem& b){
-        int c = a.ts.compareTo(b.ts);
-        if (c == 0) c = a.rfid.compareTo(b.rfid);
-        return c < 0;
-      });
+    std::sort(vec.begin(), vec.end(), spoolOlder);
+    if (vec.size() > per_scanner) vec.resize(per_scanner);
+  }
+
+  for (auto& kv : stats) {
+    kv.second.scanner      = kv.first;
+    kv.second.oldest_age_s = isoAgeSeconds(kv.second.oldest_ts);
   }
 
   return true;
@@ -158,203 +288,996 @@ bool UploaderService::spoolDeleteFiles(const std::vector<SpoolItem>& items){
       all = false;
       Serial.printf("[UP] WARN: failed to delete %s\n", items[i].path.c_str());
     }
-    if ((i & 0x1F) == 0) vTaskDelay(1);
+    spool_touch();                          // before a walk can get the bus back
+    sdfs_->yield();
+  }
+  sdfs_->unlock();
+  return all;
+}
+
+bool UploaderService::spoolQuarantine(const std::vector<SpoolItem>& items,
+                                      const std::vector<std::string>& why){
+  auto uc = cfg();
+  if (!sdfs_) return false;
+  bool all = true;
+  const char* dir = uc->dead_dir.length() ? uc->dead_dir.c_str() : "/spool_dead";
+  sdfs_->lock();
+  if (!SD.exists(dir)) SD.mkdir(dir);
+  for (size_t i=0;i<items.size();++i){
+    String dst = String(dir) + "/" + baseName(items[i].path.c_str());
+    if (SD.exists(dst.c_str())) SD.remove(dst.c_str());
+    if (!SD.rename(items[i].path.c_str(), dst.c_str())) {
+      all = false;
+      Serial.printf("[UP] WARN: failed to quarantine %s\n", items[i].path.c_str());
+      continue;
+    }
+    spool_touch();
+    File f = SD.open(dst.c_str(), FILE_APPEND);
+    if (f) { f.println(i < why.size() ? why[i].c_str() : "rejected"); f.close(); }
+    sdfs_->yield();
   }
   sdfs_->unlock();
   return all;
 }
 
 // ─────────────────────────────────────────────────────────────
-// Worker loop
+// Scheduling across scanners
 // ─────────────────────────────────────────────────────────────
-void UploaderService::taskLoop(){
-  uint32_t    next_due = 0;
-  wl_status_t prevSta  = WL_DISCONNECTED;
+String UploaderService::pickScanner(const std::map<String, ScannerStat>& stats,
+                                    const std::set<String>* busy){
+  // a busy scanner is being served right now, so it counts as served
+  auto inRound = [this, busy](const String& s){
+    if (busy && busy->count(s)) return true;
+    return std::find(served_round_.begin(), served_round_.end(), s) != served_round_.end();
+  };
 
-  for(;;){
-    // optional warmup
-    if (warmup_deadline_ms_){
-      int32_t t = (int32_t)(warmup_deadline_ms_ - millis());
-      if (t > 0){ vTaskDelay(pdMS_TO_TICKS(t > 100 ? 100 : t)); continue; }
-      warmup_deadline_ms_ = 0;
-    }
+  // Forget scanners that have drained; start a new round once everyone
+  // with pending data has had a turn.
+  served_round_.erase(std::remove_if(served_round_.begin(), served_round_.end(),
+                        [&](const String& s){ return stats.find(s) == stats.end(); }),
+                      served_round_.end());
+  bool anyLeft = false;
+  for (const auto& kv : stats) if (kv.second.pending && !inRound(kv.first)) { anyLeft = true; break; }
+  if (!anyLeft) served_round_.clear();
 
-    if (!enabled_ || cfg_.api.empty() || cfg_.interval_ms <= 1000){
-      vTaskDelay(pdMS_TO_TICKS(200));
-      continue;
+  // Oldest backlog first among the scanners still waiting in this round
+  const ScannerStat* best = nullptr;
+  for (const auto& kv : stats) {
+    const ScannerStat& st = kv.second;
+    if (!st.pending || inRound(kv.first)) continue;
+    if (!best || (st.oldest_ts.length() && (!best->oldest_ts.length() ||
+                                             st.oldest_ts.compareTo(best->oldest_ts) < 0)))
+      best = &st;
+  }
+  if (!best) return String("");
+
+  served_round_.push_back(best->scanner);
+  return best->scanner;
+}
+
+void UploaderService::publishStats(std::map<String, ScannerStat>& stats){
+  std::vector<ScannerStat> out;
+  out.reserve(stats.size());
+  for (auto& kv : stats) {
+    auto sv = served_.find(kv.first);
+    if (sv != served_.end()) {
+      kv.second.last_served_ms = sv->second.last_served_ms;
+      kv.second.batches        = sv->second.batches;
     }
+    out.push_back(kv.second);
+  }
+  xSemaphoreTake(stats_mtx_, portMAX_DELAY);
+  stats_.swap(out);
+  xSemaphoreGive(stats_mtx_);
+}
 
-    wl_status_t st = WiFi.status();
-    if (st==WL_CONNECTED && prevSta!=WL_CONNECTED) { next_due = 0; }
-    prevSta = st;
+std::vector<UploaderService::ScannerStat> UploaderService::scannerStats() const {
+  xSemaphoreTake(stats_mtx_, portMAX_DELAY);
+  std::vector<ScannerStat> copy = stats_;
+  xSemaphoreGive(stats_mtx_);
+  return copy;
+}
 
-    if (next_due == 0) next_due = millis();
-    int32_t remain = (int32_t)(next_due - millis());
-    if (remain > 0){ vTaskDelay(pdMS_TO_TICKS(remain > 50 ? 50 : remain)); continue; }
+// ─────────────────────────────────────────────────────────────
+// Adaptive cadence
+// ─────────────────────────────────────────────────────────────
+uint32_t UploaderService::nextDelayMs(size_t remaining, int32_t oldest_age_s){
+  auto uc = cfg();
+  const size_t threshold = uc->drain_threshold ? uc->drain_threshold : 2 * batchLimit();
+  uint32_t wait = uc->interval_ms;
+  debug_.backlog  = remaining;
+  metrics::spool_pending.set((int32_t)remaining);
+  debug_.draining = remaining > threshold;
 
-    if (WiFi.status() != WL_CONNECTED) { next_due = millis() + cfg_.interval_ms; continue; }
+  if (debug_.draining) {
+    wait = uc->drain_gap_ms;                       // catch up back-to-back
+  } else if (remaining && uc->flush_deadline_ms && oldest_age_s >= 0) {
+    uint64_t age_ms = (uint64_t)oldest_age_s * 1000ULL;
+    uint32_t left = (age_ms >= uc->flush_deadline_ms) ? 0 : (uint32_t)(uc->flush_deadline_ms - age_ms);
+    if (left < uc->drain_gap_ms) left = uc->drain_gap_ms;
+    if (left < wait) wait = left;                   // flush before the deadline
+  }
+  debug_.next_in_ms = wait;
+  return wait;
+}
 
-    if (ESP.getFreeHeap() < 25000) {
-      debug_.last_ms = millis();
-      debug_.success = false;
-      debug_.code = -1;
-      debug_.error = "low_heap";
-      next_due = millis() + 2000;
-      vTaskDelay(pdMS_TO_TICKS(100));
-      continue;
-    }
+size_t UploaderService::batchLimit() const {
+  auto uc = cfg();
+  size_t n = uc->batch_size ? uc->batch_size : 50;
+  if (!uc->adaptive_batch) return n;
+  if (aimd_items_.load()) n = aimd_items_.load();
+  uint32_t bpi = bytes_per_item_;
+  if (bpi && uc->body_budget) {
+    size_t cap = uc->body_budget / bpi;
+    if (cap < n) n = cap;
+  }
+  return n ? n : 1;
+}
 
-    Serial.println("[UP] Starting upload cycle");
-    Serial.printf(" task=%p core=%d heap=%u\n",
-                  xTaskGetCurrentTaskHandle(), xPortGetCoreID(), (unsigned)ESP.getFreeHeap());
-    Serial.printf(" API: %s\n", cfg_.api.c_str());
-    Serial.printf(" Source: %s\n", cfg_.use_sd_spool ? "spool" : "repo");
-
-    // ======== SPOOL MODE ========
-    if (cfg_.use_sd_spool && sdfs_) {
-      Serial.printf(" Spool dir: %s\n", cfg_.spool_dir.c_str());
-      const size_t want = (cfg_.batch_size ? cfg_.batch_size : 50);
-
-      // scan a bit more to form groups
-      std::map<String, std::vector<SpoolItem>> groups;
-      bool okList = spoolListGrouped(want * 8, groups);
-      if (!okList) {
-        debug_.last_ms = millis(); debug_.success = false; debug_.code = -10; debug_.error = "spool_list_failed";
-        next_due = millis() + cfg_.interval_ms;
-        continue;
-      }
+// Additive increase while full batches come back under the latency target,
+// multiplicative decrease when the link is the problem (timeouts, transport
+// errors, 408/413/504). Server-side errors leave the size alone; the breaker
+// deals with those.
+void UploaderService::adaptBatch(const Batch& b){
+  auto uc = cfg();
+  if (!b.sent) return;
+  uint32_t rtt = millis() - b.submit_ms;
+  rtt_ewma_ms_ = rtt_ewma_ms_ ? (3 * rtt_ewma_ms_ + rtt) / 4 : rtt;
+  if (b.count()) bytes_per_item_ = b.body_len / b.count();
 
-      if (groups.empty()) {
-        debug_.last_ms = millis(); debug_.success = true; debug_.code = 204; debug_.error.clear();
-        next_due = millis() + cfg_.interval_ms;
-        continue;
-      }
+  size_t lo = uc->batch_min ? uc->batch_min : 1;
+  size_t hi = uc->batch_max > lo ? uc->batch_max : lo;
+  size_t cur = aimd_items_.load() ? aimd_items_.load() : (uc->batch_size ? uc->batch_size : 50);
+  const bool linkTrouble = b.code <= 0 || b.code == 408 || b.code == 413 || b.code == 504;
 
-      // Pick first non-empty scanner group
-      auto it = groups.begin();
-      while (it != groups.end() && it->second.empty()) ++it;
-      if (it == groups.end()) {
-        debug_.last_ms = millis(); debug_.success = true; debug_.code = 204; debug_.error.clear();
-        next_due = millis() + cfg_.interval_ms;
-        continue;
-      }
+  if (uc->adaptive_batch) {
+    if (linkTrouble)                               cur = cur / 2;
+    else if (b.success && b.count() >= cur &&
+             rtt < uc->latency_target_ms)         cur += uc->batch_step ? uc->batch_step : 1;
+    if (cur < lo) cur = lo;
+    if (cur > hi) cur = hi;
+    aimd_items_ = cur;
+  }
+  debug_.batch_target = cur;
+  debug_.rtt_ms       = rtt_ewma_ms_;
+  debug_.batch_limit  = batchLimit();
+}
 
-      const String scanner = it->first;
-      auto items = it->second;
-      if (items.size() > want) items.resize(want);
+void UploaderService::noteDrained(size_t items){
+  uint32_t now = millis();
+  if (!drain_t0_ms_) drain_t0_ms_ = now;
+  drain_items_ += items;
+  uint32_t el = now - drain_t0_ms_;
+  if (el >= 5000) {
+    debug_.drain_rate = (float)drain_items_ * 1000.f / (float)el;
+    drain_t0_ms_ = now; drain_items_ = 0;
+  }
+}
 
-      Serial.printf("[UP] Spool: scanner=%s items=%u\n", scanner.c_str(), (unsigned)items.size());
-      for (auto& si : items) {
-        Serial.printf("  file=%s rfid=%s ts=%s\n", si.path.c_str(), si.rfid.c_str(), si.ts.c_str());
-      }
+// ─────────────────────────────────────────────────────────────
+// Backoff + circuit breaker
+// ─────────────────────────────────────────────────────────────
+const char* UploaderService::breakerName(Breaker b){
+  switch (b) {
+    case Breaker::Closed:   return "closed";
+    case Breaker::Open:     return "open";
+    case Breaker::HalfOpen: return "half_open";
+  }
+  return "unknown";
+}
 
-      // Build JSON: {"data":[{"rfid":"..","timestamp":".."}, ...]}
-      std::string body; body.reserve(96 + 64*items.size());
-      body += "{\"data\":[";
-      for (size_t i=0;i<items.size();++i){
-        if (i) body += ',';
-        body += "{\"rfid\":\""; body += items[i].rfid.c_str();
-        body += "\",\"timestamp\":\""; body += items[i].ts.length()? items[i].ts.c_str() : "";
-        body += "\"}";
-      }
-      body += "]}";
+UploaderService::BreakerInfo UploaderService::breaker() const {
+  BreakerInfo b;
+  b.state       = breaker_;
+  b.consec_fail = consec_fail_;
+  b.trips       = trips_;
+  b.last_code   = last_code_;
+  int32_t left  = (int32_t)(open_until_ms_ - millis());
+  b.retry_in_ms = (consec_fail_ && left > 0) ? (uint32_t)left : 0;
+  return b;
+}
 
-      bool success=false; int code=0; std::string resp; std::string failMsg;
-      debug_.url = cfg_.api; debug_.scanner = scanner.c_str(); debug_.sent = body.size();
-      debug_.items = items.size(); debug_.array_body = false;
+void UploaderService::resetBreaker(){
+  consec_fail_   = 0;
+  open_until_ms_ = 0;
+  breaker_       = Breaker::Closed;
+}
 
-      const std::string apiKey = scanner.length() ? std::string(scanner.c_str())
-                                                  : std::string("SCANNER_UNKNOWN");
+void UploaderService::onSuccess(){
+  if (breaker_ != Breaker::Closed)
+    Serial.printf("[UP] Breaker %s -> closed\n", breakerName(breaker_));
+  resetBreaker();
+  last_code_ = 200;
+}
 
-      delay(0);
+// base * 2^(n-1), capped, with "equal jitter": uniform in [d/2, d] so that
+// devices knocked off by the same outage do not come back in lock-step
+uint32_t UploaderService::backoffMs() const {
+  auto uc = cfg();
+  uint32_t base = uc->backoff_base_ms ? uc->backoff_base_ms : 1000;
+  uint32_t cap  = uc->backoff_max_ms  ? uc->backoff_max_ms  : 300000;
+  uint16_t n = consec_fail_ ? consec_fail_ - 1 : 0;
+  uint32_t d = base;
+  while (n-- && d < cap) d = (d > cap / 2) ? cap : d * 2;
+  if (d > cap) d = cap;
+  uint32_t half = d / 2;
+  return half + (half ? (esp_random() % (half + 1)) : 0);
+}
 
-      for (uint8_t attempt=0; attempt<=cfg_.retry_count; ++attempt){
-        bool ok = net_.postJson(cfg_.api, body, code, resp, apiKey);
-        if (ok && code>=200 && code<300){ success=true; break; }
-        failMsg = ok ? (std::string("HTTP_") + std::to_string(code)) : std::string("NET_ERR");
-        if (attempt < cfg_.retry_count) vTaskDelay(pdMS_TO_TICKS(cfg_.retry_delay_ms));
-      }
+uint32_t UploaderService::onFailure(int code, uint32_t retry_after_ms){
+  auto uc = cfg();
+  consec_fail_++;
+  last_code_ = code;
+  uint32_t wait = backoffMs();
 
-      debug_.last_ms = millis(); debug_.code = code; debug_.success = success;
-      debug_.resp_size = resp.size(); debug_.error = success? std::string() : failMsg;
+  const bool throttled = (code == 429 || code == 503);
+  if (retry_after_ms > wait) wait = retry_after_ms;      // server knows best
 
-      next_due = millis() + cfg_.interval_ms;
+  const uint16_t threshold = uc->breaker_threshold ? uc->breaker_threshold : 5;
+  if (breaker_ == Breaker::HalfOpen || throttled || consec_fail_ >= threshold) {
+    if (breaker_ != Breaker::Open) {
+      trips_++;
+      Serial.printf("[UP] Breaker %s -> open (code=%d, consec_fail=%u, retry in %ums)\n",
+                    breakerName(breaker_), code, (unsigned)consec_fail_, (unsigned)wait);
+    }
+    breaker_ = Breaker::Open;
+  }
+  open_until_ms_ = millis() + wait;
+  return wait;
+}
 
-      if (success){
-        consec_fail_ = 0;
-        if (spoolDeleteFiles(items)) {
-          Serial.printf("[UP] Sent & deleted %u files for scanner=%s\n", (unsigned)items.size(), scanner.c_str());
-        } else {
-          Serial.printf("[UP] Sent %u files but some deletes failed (scanner=%s)\n", (unsigned)items.size(), scanner.c_str());
-        }
-      } else {
-        Serial.printf("[UP] Spool upload failed: code=%d err=%s (scanner=%s)\n", code, failMsg.c_str(), scanner.c_str());
-        consec_fail_++;
-        if (code==401 || code==403 || consec_fail_ >= kMaxConsecFail){
-          Serial.printf("[UP] Disabling uploader (code=%d, consec_fail=%u)\n", code, (unsigned)consec_fail_);
-          enabled_ = false;
-        }
-      }
-      continue;
+bool UploaderService::breakerBlocks(){
+  if (breaker_ != Breaker::Open) return false;
+  int32_t left = (int32_t)(open_until_ms_ - millis());
+  if (left > 0) { next_due_ = open_until_ms_; return true; }
+  breaker_ = Breaker::HalfOpen;                           // let one probe through
+  Serial.println("[UP] Breaker open -> half_open (probing)");
+  return false;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Stages
+// ─────────────────────────────────────────────────────────────
+
+// Record fields go into the body verbatim (no JSON escaping) and a whole
+// record has to fit BatchBody's stage buffer. LoRa ingest guarantees both;
+// a stray spool file or an old repo entry may not, and is dead-lettered
+// when the batch is built instead of corrupting the request.
+using upload_codec::kMaxRfid;
+using upload_codec::kMaxTs;
+using upload_codec::kMaxId;
+static bool fieldOk(const char* s, size_t max){
+  size_t n = 0;
+  for (; s[n]; ++n) {
+    unsigned char c = (unsigned char)s[n];
+    if (n >= max || c < 0x20 || c == '"' || c == '\\') return false;
+  }
+  return true;
+}
+
+// SD stage: pick the next scanner and read its oldest records (or the repo
+// window), excluding everything already on its way to the server.
+bool UploaderService::prepareBatch(Batch& b){
+  auto uc = cfg();
+  uint32_t t0 = millis();
+  const size_t want = batchLimit();
+
+  if (uc->use_sd_spool && sdfs_) {
+    // full scan: every scanner is seen, each group capped at one batch
+    std::map<String, std::vector<SpoolItem>> groups;
+    std::map<String, ScannerStat> stats;
+    if (!spoolListGrouped(want, groups, stats)) {
+      xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+      debug_.last_ms = millis(); debug_.success = false; debug_.code = -10; debug_.error = "spool_list_failed";
+      publishDebug();
+      xSemaphoreGive(settle_mtx_);
+      return false;
     }
 
+    // Fair pick across scanners (see pickScanner); with parallel connections
+    // a scanner never has two batches outstanding, which keeps its order
+    const bool exclusive = exclusiveScanners();
+    const String scanner = pickScanner(stats, exclusive ? &busy_ : nullptr);
+    if (!scanner.length()) {
+      publishStats(stats);
+      for (const auto& kv : stats) if (kv.second.pending) { b.blocked = true; break; }
+      return false;
+    }
+
+    ScannerStat& served = served_[scanner];
+    served.last_served_ms = millis();
+    served.batches++;
+    publishStats(stats);
+
+    b.repo    = false;
+    b.scanner = scanner;
+    b.items   = std::move(groups[scanner]);
+    size_t cap = want;
+    auto sus = suspect_.find(scanner);
+    if (sus != suspect_.end() && sus->second < cap) cap = sus->second;
+    if (b.items.size() > cap) b.items.resize(cap);
+
+    std::vector<SpoolItem> bad;
+    std::vector<std::string> why;
+    for (size_t i = 0; i < b.items.size(); ) {
+      const SpoolItem& si = b.items[i];
+      if (fieldOk(si.rfid.c_str(), kMaxRfid) && fieldOk(si.ts.c_str(), kMaxTs) &&
+          fieldOk(baseName(si.path.c_str()).c_str(), kMaxId)) { ++i; continue; }
+      bad.push_back(si);
+      why.push_back("malformed record");
+      b.items.erase(b.items.begin() + i);
+    }
+    if (bad.size()) {
+      spoolQuarantine(bad, why);
+      Serial.printf("[UP] Dead-lettered %u malformed files (scanner=%s)\n", (unsigned)bad.size(), scanner.c_str());
+    }
+
+    for (const auto& si : b.items) { inflight_.insert(si.path); b.claimed.push_back(si.path); }
+    if (b.items.size()) busy_.insert(scanner);
+
+    // What is left after this batch decides how soon the next one goes
+    for (const auto& kv : stats) {
+      size_t left = kv.second.pending;
+      size_t took = (kv.first == scanner) ? b.items.size() + bad.size() : 0;
+      left = (left > took) ? left - took : 0;
+      b.remaining += left;
+      if (left && kv.second.oldest_age_s > b.oldest_age_s) b.oldest_age_s = kv.second.oldest_age_s;
+    }
+
+    Serial.printf("[UP] Spool: scanner=%s items=%u\n", scanner.c_str(), (unsigned)b.items.size());
+    for (auto& si : b.items) {
+      Serial.printf("  file=%s rfid=%s ts=%s\n", si.path.c_str(), si.rfid.c_str(), si.ts.c_str());
+    }
+  } else {
     // ======== REPO MODE (fallback) ========
     auto window = repo_.listUnsent((size_t)500);
-    if (window.empty()) { next_due = millis() + cfg_.interval_ms; continue; }
+    if (window.empty()) return false;
 
     std::string scanner = window.front().scanner_id;
     Serial.printf("[UP] Uploading batch for scanner=%s (items=%u)\n", scanner.c_str(), (unsigned)window.size());
-    std::vector<domain::LogEntry> batch; batch.reserve(window.size());
-    for (const auto& e : window){ if (e.scanner_id == scanner) batch.push_back(e); }
-    size_t maxItems = (consec_fail_ > 0) ? 1 : cfg_.batch_size;
-    if (maxItems == 0) maxItems = 1;
-    if (batch.size() > maxItems) batch.resize(maxItems);
+    b.repo = true;
+    b.scanner = scanner.c_str();
+    b.entries.reserve(window.size());
+    for (const auto& e : window){ if (e.scanner_id == scanner) b.entries.push_back(e); }
+    size_t maxItems = want;
+    auto sus = suspect_.find(b.scanner);
+    if (sus != suspect_.end() && sus->second < maxItems) maxItems = sus->second;
+    if (b.entries.size() > maxItems) b.entries.resize(maxItems);
 
-    std::string body; body.reserve(80 + 80*batch.size());
-    body += "{\"data\":[";
-    for (size_t i=0;i<batch.size();++i){
-      const auto& e = batch[i];
-      if (i) body += ',';
-      body += "{\"rfid\":\""; body += e.rfid;
-      body += "\",\"timestamp\":\""; body += e.ts_iso; body += "\"}";
-      Serial.printf("  scanner=%s rfid=%s ts=%s\n", e.scanner_id.c_str(), e.rfid.c_str(), e.ts_iso.c_str());
+    std::vector<domain::LogEntry> bad;
+    for (size_t i = 0; i < b.entries.size(); ) {
+      const auto& e = b.entries[i];
+      char id[kMaxId + 2];
+      snprintf(id, sizeof(id), "%s.%s", e.rfid.c_str(), e.ts_iso.c_str());
+      if (fieldOk(e.rfid.c_str(), kMaxRfid) && fieldOk(e.ts_iso.c_str(), kMaxTs) && fieldOk(id, kMaxId)) { ++i; continue; }
+      bad.push_back(e);
+      b.entries.erase(b.entries.begin() + i);
+    }
+    if (bad.size()) {
+      repo_.markDead(bad, "REJECTED: malformed record");
+      Serial.printf("[UP] Dead-lettered %u malformed entries (scanner=%s)\n", (unsigned)bad.size(), scanner.c_str());
     }
-    body += "]}";
+    // repo window is capped at 500, which is enough to tell "backlog" from "idle"
+    b.remaining = window.size() - b.entries.size() - bad.size();
+  }
 
-    bool success=false; int code=0; std::string resp; std::string failMsg;
+  b.sd_ms = millis() - t0;
+  return true;
+}
 
-    debug_.url = cfg_.api; debug_.scanner = scanner; debug_.sent = body.size(); debug_.items = batch.size(); debug_.array_body = false;
+// Stable record id used by the per-item ack: the spool file name (unique and
+// unchanged across retries), or "<rfid>.<timestamp>" for repo entries.
+void UploaderService::itemId(const Batch& b, size_t i, char* out, size_t cap){
+  if (b.repo) { snprintf(out, cap, "%s.%s", b.entries[i].rfid.c_str(), b.entries[i].ts_iso.c_str()); return; }
+  const char* p = b.items[i].path.c_str();
+  const char* slash = strrchr(p, '/');
+  snprintf(out, cap, "%s", slash ? slash + 1 : p);
+}
 
-    const std::string apiKey = scanner.empty() ? std::string("SCANNER_UNKNOWN") : scanner;
+// Serializes a batch record by record straight into the HTTP client's send
+// buffer, as JSON {"data":[{"id":"..","rfid":"..","timestamp":".."}, ...]}
+// or the MessagePack equivalent (see UploadFormat). Only one record is
+// staged at a time, so body size no longer costs heap.
+class UploaderService::BatchBody : public BodySource {
+  const Batch& b_;
+  const bool   ids_;
+  const bool   mp_;
+  std::vector<int64_t> epoch_;    // msgpack: parsed once, used by both passes
+  size_t       total_ = 0;
+  uint32_t     encode_us_ = 0;
+  size_t       seg_   = 0;        // 0 = header, 1..n = records, n+1 = trailer
+  char         stage_[224];
+  static_assert(sizeof(stage_) > upload_codec::kPieceMax, "stage_ must hold any piece");
+  size_t       len_ = 0, pos_ = 0;
 
-    delay(0);
+  // Stages segment seg and returns its length as read() emits it; the
+  // constructor sums these same values, so Content-Length always matches
+  size_t stage(size_t seg) {
+    size_t n = format(seg, stage_, sizeof(stage_));
+    return n < sizeof(stage_) ? n : sizeof(stage_) - 1;
+  }
 
-    for (uint8_t attempt=0; attempt<=cfg_.retry_count; ++attempt){
-      bool ok = net_.postJson(cfg_.api, body, code, resp, apiKey);
-      if (ok && code>=200 && code<300){ success=true; break; }
-      failMsg = ok ? (std::string("HTTP_") + std::to_string(code)) : std::string("NET_ERR");
-      if (attempt < cfg_.retry_count) vTaskDelay(pdMS_TO_TICKS(cfg_.retry_delay_ms));
+  size_t format(size_t seg, char* out, size_t cap) const {
+    using namespace upload_codec;
+    const size_t n = b_.count();
+    if (seg == 0)     return mp_ ? mpHead((uint8_t*)out, n) : jsonHead(out, cap);
+    if (seg == n + 1) return mp_ ? 0 : jsonTail(out, cap);
+    const size_t i = seg - 1;
+    char id[kMaxId + 1];
+    if (ids_) itemId(b_, i, id, sizeof(id));
+    Record r;
+    r.id    = ids_ ? id : nullptr;
+    r.rfid  = b_.repo ? b_.entries[i].rfid.c_str()   : b_.items[i].rfid.c_str();
+    r.ts    = b_.repo ? b_.entries[i].ts_iso.c_str() : b_.items[i].ts.c_str();
+    r.epoch = mp_ ? epoch_[i] : -1;
+    return mp_ ? mpRecord((uint8_t*)out, r) : jsonRecord(out, cap, i, r);
+  }
+public:
+  BatchBody(const Batch& b, bool ids, UploadFormat fmt)
+    : b_(b), ids_(ids), mp_(fmt == UploadFormat::MsgPack) {
+    uint32_t t0 = micros();
+    if (mp_) {
+      epoch_.resize(b_.count());
+      for (size_t i = 0; i < b_.count(); ++i)
+        epoch_[i] = isoToEpoch(b_.repo ? b_.entries[i].ts_iso.c_str() : b_.items[i].ts.c_str());
     }
+    for (size_t seg = 0; seg <= b_.count() + 1; ++seg) total_ += stage(seg);
+    encode_us_ = micros() - t0;
+  }
+  uint32_t encodeUs() const { return encode_us_; }
+  const char* contentType() const { return mp_ ? "application/msgpack" : "application/json"; }
+  size_t size() const override { return total_; }
+  void rewind() override { seg_ = 0; len_ = pos_ = 0; }
+  size_t read(uint8_t* dst, size_t max) override {
+    size_t out = 0;
+    while (out < max) {
+      if (pos_ == len_) {
+        if (seg_ > b_.count() + 1) break;
+        len_ = stage(seg_++); pos_ = 0;
+      }
+      size_t n = len_ - pos_; if (n > max - out) n = max - out;
+      memcpy(dst + out, stage_ + pos_, n);
+      pos_ += n; out += n;
+    }
+    return out;
+  }
+};
 
-    debug_.last_ms = millis(); debug_.code = code; debug_.success = success; debug_.resp_size = resp.size(); debug_.error = success? std::string() : failMsg;
-    next_due = millis() + cfg_.interval_ms;
+// Network stage
+void UploaderService::sendBatch(Batch& b, bool probe, NetClient& net){
+  auto uc = cfg();
+  b.submit_ms = millis();
+  if (probe && b.count() > 1) {
+    // half-open breaker: probe with a single record, the rest stays pending
+    b.remaining += b.count() - 1;
+    if (b.repo) b.entries.resize(1);
+    else        b.items.resize(1);
+  }
+  BatchBody body(b, uc->item_ids, uc->format);
+  b.body_len = body.size();
+  metrics::upload_requests.inc();
+  metrics::upload_bytes.inc((uint32_t)b.body_len);
+  xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+  debug_.format = (uc->format == UploadFormat::MsgPack) ? "msgpack" : "json";
+  debug_.encode_us = body.encodeUs();
+  debug_.bytes_per_item = b.count() ? (uint32_t)(b.body_len / b.count()) : 0;
 
-    if (success){
-      consec_fail_ = 0;
-      repo_.markSent(batch);
+  debug_.url = uc->api; debug_.scanner = b.scanner.c_str(); debug_.sent = b.body_len;
+  debug_.items = b.count(); debug_.array_body = false;
+  debug_.pipeline = uc->pipeline;
+  publishDebug();
+  xSemaphoreGive(settle_mtx_);
+
+  const std::string apiKey = b.scanner.length() ? std::string(b.scanner.c_str())
+                                                : std::string("SCANNER_UNKNOWN");
+  if (window_ > 1 && &net == &net_) {
+    // windowed transport: queued now, reapBatch() picks up the ack later
+    b.ticket = net.submit(uc->api, body, apiKey, body.contentType());
+    b.ack_timeout_ms = net.ackTimeoutMs(uc->api);
+    if (!b.ticket) { b.code = -1; b.failMsg = "NET_ERR"; }
+    return;
+  }
+
+  std::string resp;
+  delay(0);
+
+  for (uint8_t attempt=0; attempt<=uc->retry_count; ++attempt){
+    bool ok = net.postBody(uc->api, body, b.code, resp, apiKey, body.contentType());
+    if (ok && b.code>=200 && b.code<300){ b.success=true; break; }
+    b.failMsg = ok ? (std::string("HTTP_") + std::to_string(b.code)) : std::string("NET_ERR");
+    if (b.code==401 || b.code==403 || b.code==429 || b.code==503) break;   // retrying now won't help
+    if (b.code==400 || b.code==413 || b.code==422) break;                   // the data itself is refused
+    if (attempt < uc->retry_count) vTaskDelay(pdMS_TO_TICKS(uc->retry_delay_ms));
+  }
+  b.timing = net.lastTiming();
+  b.retry_after_ms = net.retryAfterMs();   // per connection: workers do not share net_
+  finishSend(b, resp);
+}
+
+// Network stage, windowed transports: true once the batch has its outcome.
+// Unacked past the transport's ack timeout counts as a failure and the
+// records stay pending to be sent again. MQTT has none: it settles a ticket
+// as failed itself once the outbox no longer holds the publish, since a
+// resend before that would go out next to the outbox's own retransmission.
+bool UploaderService::reapBatch(Batch& b, uint32_t wait_ms){
+  std::string resp;
+  if (b.ticket) {
+    if (!net_.collect(b.ticket, wait_ms, b.code, resp)) {
+      if (!b.ack_timeout_ms || (uint32_t)(millis() - b.submit_ms) < b.ack_timeout_ms) return false;
+      net_.forget(b.ticket);
+      b.code = -1;
+    }
+    b.success = (b.code >= 200 && b.code < 300);
+    if (!b.success) b.failMsg = (b.code == -1) ? std::string("NO_ACK")
+                                               : (std::string("HTTP_") + std::to_string(b.code));
+  }
+  finishSend(b, resp);
+  return true;
+}
+
+void UploaderService::finishSend(Batch& b, const std::string& resp){
+  b.sent = true;
+  metrics::upload_seconds.observe(millis() - b.submit_ms);
+  xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+  judgeBatch(b, resp);
+
+  debug_.last_ms = millis(); debug_.code = b.code; debug_.success = b.success;
+  debug_.resp_size = resp.size(); debug_.error = b.success? std::string() : b.failMsg;
+  debug_.sd_ms = b.sd_ms; debug_.net_ms = millis() - b.submit_ms;
+  debug_.timing = b.timing;
+  publishDebug();
+  xSemaphoreGive(settle_mtx_);
+}
+
+static bool isDataReject(int code){ return code==400 || code==413 || code==422; }
+
+// Network stage: per-record verdict from the response. With the per-item
+// contract only the listed records are settled; anything the server did not
+// mention stays pending. Without it the batch is all-or-nothing, except that
+// a lone record refused as bad data is dead-lettered.
+void UploaderService::judgeBatch(Batch& b, const std::string& resp){
+  auto uc = cfg();
+  const size_t n = b.count();
+  b.verdict.assign(n, Pending);
+  b.reason.assign(n, std::string());
+
+  if (uc->item_ids && resp.size() && (resp.find("\"accepted\"") != std::string::npos ||
+                                       resp.find("\"rejected\"") != std::string::npos)) {
+    JsonDocument doc;
+    if (!deserializeJson(doc, resp)) {
+      JsonArrayConst acc = doc["accepted"];
+      JsonArrayConst rej = doc["rejected"];
+      if (!acc.isNull() || !rej.isNull()) {
+        b.item_ack = true;
+        std::map<std::string, size_t> index;
+        char id[96];
+        for (size_t i = 0; i < n; ++i) { itemId(b, i, id, sizeof(id)); index[id] = i; }
+
+        // 2xx without "accepted": everything not rejected went through
+        if (acc.isNull() && b.success) b.verdict.assign(n, Accepted);
+        for (JsonVariantConst v : acc) {
+          const char* k = v.as<const char*>();
+          auto it = k ? index.find(k) : index.end();
+          if (it != index.end()) b.verdict[it->second] = Accepted;
+        }
+        for (JsonVariantConst v : rej) {
+          const char* k   = v.is<const char*>() ? v.as<const char*>() : (v["id"] | (const char*)nullptr);
+          const char* err = v["error"] | "rejected";
+          bool retryable  = v["retryable"] | false;
+          auto it = k ? index.find(k) : index.end();
+          if (it == index.end()) continue;
+          b.verdict[it->second] = retryable ? Pending : Dead;
+          b.reason[it->second]  = err;
+        }
+      }
+    }
+  }
+
+  if (!b.item_ack) {
+    if (b.success) b.verdict.assign(n, Accepted);
+    else if (n == 1 && isDataReject(b.code) && loneDeadAllowed()) { b.verdict[0] = Dead; b.reason[0] = b.failMsg; }
+  }
+
+  size_t acc = 0, dead = 0;
+  for (uint8_t v : b.verdict) { if (v == Accepted) acc++; else if (v == Dead) dead++; }
+  if (acc && !lone_trust_) {
+    lone_trust_ = true;
+    Serial.println("[UP] Server accepts records again; lone rejects may be dead-lettered");
+  }
+  debug_.accepted = acc; debug_.rejected = dead; debug_.item_ack = b.item_ack;
+  metrics::upload_items.inc(acc);
+  if (!b.success) metrics::upload_failures.inc();
+  debug_.dead_total += dead;
+}
+
+// Caller holds settle_mtx_
+bool UploaderService::loneDeadAllowed(){
+  const uint32_t now = millis();
+  if (now - lone_t0_ms_ >= kLoneDeadWindowMs) { lone_t0_ms_ = now; lone_dead_ = 0; }
+  if (!lone_trust_) return false;
+  if (lone_dead_ >= kLoneDeadCap) {
+    lone_trust_ = false;
+    Serial.printf("[UP] %u lone records refused within %us; treating rejects as failures\n",
+                  (unsigned)lone_dead_, (unsigned)(kLoneDeadWindowMs / 1000));
+    return false;
+  }
+  lone_dead_++;
+  return true;
+}
+
+// Network stage: decide when the next batch may go
+void UploaderService::settleBatch(const Batch& b){
+  adaptBatch(b);
+  size_t settled = 0;
+  for (uint8_t v : b.verdict) if (v != Pending) settled++;
+  noteDrained(settled);
+  // Partial success and multi-record data rejects (being bisected) mean the
+  // server is healthy: keep the cadence and leave the breaker alone; what is
+  // still pending goes next. A lone reject that was not dead-lettered is a
+  // failure like any other.
+  if (b.success || settled || (isDataReject(b.code) && b.count() > 1)){
+    onSuccess();
+    next_due_ = millis() + nextDelayMs(b.remaining + (b.count() - settled), b.oldest_age_s);
+    return;
+  }
+  next_due_ = millis() + onFailure(b.code, b.retry_after_ms);
+  if (b.code==401 || b.code==403){
+    // credentials are wrong; backing off will not fix that
+    Serial.printf("[UP] Disabling uploader (code=%d)\n", b.code);
+    enabled_ = false;
+  }
+}
+
+// SD stage: apply the server's verdict
+void UploaderService::ackBatch(Batch& b){
+  auto uc = cfg();
+  uint32_t t0 = millis();
+  if (b.sent) {
+    // Halve the batch for this scanner while the server keeps refusing it
+    // as a whole; back to full size once something goes through again.
+    bool any = false;
+    for (uint8_t v : b.verdict) if (v != Pending) { any = true; break; }
+    if (any)                                                   suspect_.erase(b.scanner);
+    else if (isDataReject(b.code) && !b.item_ack && b.count() > 1) suspect_[b.scanner] = b.count() / 2;
+  }
+
+  if (b.repo) {
+    std::vector<domain::LogEntry> ok, retry;
+    std::map<std::string, std::vector<domain::LogEntry>> dead;   // grouped by reason
+    for (size_t i = 0; i < b.entries.size() && b.sent; ++i) {
+      uint8_t v = i < b.verdict.size() ? b.verdict[i] : (uint8_t)Pending;
+      if (v == Accepted)  ok.push_back(b.entries[i]);
+      else if (v == Dead) dead[b.reason[i].size() ? b.reason[i] : std::string("rejected")].push_back(b.entries[i]);
+      else                retry.push_back(b.entries[i]);
+    }
+    if (ok.size()){
+      repo_.markSent(ok);
       Serial.println("[UP] Uploaded batch:");
-      for (auto& e : batch){
+      for (auto& e : ok){
         Serial.printf("  scanner=%s rfid=%s ts=%s\n", e.scanner_id.c_str(), e.rfid.c_str(), e.ts_iso.c_str());
       }
-    } else {
-      size_t sentCount = 0;
-      Serial.printf("[UP] Upload failed: code=%d err=%s (sent %u of %u individually)\n", code, failMsg.c_str(), (unsigned)sentCount, (unsigned)batch.size());
-      repo_.markFailed(batch, failMsg);
-      consec_fail_++;
-      if (code==401 || code==403 || consec_fail_ >= kMaxConsecFail){
-        Serial.printf("[UP] Disabling uploader (code=%d, consec_fail=%u)\n", code, (unsigned)consec_fail_);
-        enabled_ = false;
+    }
+    for (auto& kv : dead){
+      Serial.printf("[UP] Dead-lettered %u entries: %s\n", (unsigned)kv.second.size(), kv.first.c_str());
+      repo_.markDead(kv.second, std::string("REJECTED: ") + kv.first);
+    }
+    if (retry.size()) {
+      Serial.printf("[UP] Upload failed: code=%d err=%s (%u items)\n", b.code, b.failMsg.c_str(), (unsigned)retry.size());
+      repo_.markFailed(retry, b.item_ack ? std::string("RETRY") : b.failMsg);
+    }
+  } else {
+    std::vector<SpoolItem> ok, dead;
+    std::vector<std::string> why;
+    for (size_t i = 0; i < b.items.size() && b.sent; ++i) {
+      uint8_t v = i < b.verdict.size() ? b.verdict[i] : (uint8_t)Pending;
+      if (v == Accepted)  ok.push_back(b.items[i]);
+      else if (v == Dead) { dead.push_back(b.items[i]); why.push_back(b.reason[i]); }
+    }
+    if (ok.size()){
+      if (spoolDeleteFiles(ok)) {
+        Serial.printf("[UP] Sent & deleted %u files for scanner=%s\n", (unsigned)ok.size(), b.scanner.c_str());
+      } else {
+        Serial.printf("[UP] Sent %u files but some deletes failed (scanner=%s)\n", (unsigned)ok.size(), b.scanner.c_str());
       }
     }
+    if (dead.size()){
+      spoolQuarantine(dead, why);
+      Serial.printf("[UP] Dead-lettered %u files to %s (scanner=%s)\n", (unsigned)dead.size(), uc->dead_dir.c_str(), b.scanner.c_str());
+    }
+    if (b.sent && ok.size() + dead.size() < b.items.size()) {
+      Serial.printf("[UP] Spool upload failed: code=%d err=%s (scanner=%s, %u pending)\n", b.code, b.failMsg.c_str(),
+                    b.scanner.c_str(), (unsigned)(b.items.size() - ok.size() - dead.size()));
+    }
+    for (const auto& p : b.claimed) inflight_.erase(p);
+    if (b.claimed.size()) busy_.erase(b.scanner);
+  }
+  if (b.sent) {
+    xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+    debug_.ack_ms = millis() - t0;
+    publishDebug();
+    xSemaphoreGive(settle_mtx_);
+  }
+}
+
+// Network stage gate; returns true when a batch may be sent right now
+bool UploaderService::gateOpen(){
+  // optional warmup
+  if (warmup_deadline_ms_){
+    int32_t t = (int32_t)(warmup_deadline_ms_ - millis());
+    if (t > 0){ waitWake(t); return false; }
+    warmup_deadline_ms_ = 0;
+  }
+
+  bool runnable;
+  {
+    auto uc = cfg();                              // never held across a wait
+    runnable = enabled_ && !uc->api.empty() && uc->interval_ms > 1000;
+  }
+  if (!runnable){
+    waitWake(kForever);                           // set()/setEnabled() wake us
+    return false;
+  }
+
+  bool up = (WiFi.status() == WL_CONNECTED);
+  if (up && !prev_sta_up_) { next_due_ = 0; idle_ = false; net_.prewarm(cfg()->api); }
+  prev_sta_up_ = up;
+  if (!up) { waitWake(kForever); return false; }  // GOT_IP wakes us
+
+  // Nothing pending: no timer at all, ingest/config/start wake us
+  if (idle_) { waitWake(kForever); return false; }
+
+  if (next_due_ == 0) next_due_ = millis();
+  int32_t remain = (int32_t)(next_due_ - millis());
+  if (remain > 0){ waitWake((uint32_t)remain); return false; }
+
+  // Open breaker: nothing goes out until the cool-down has elapsed
+  if (breakerBlocks()) return false;
+
+  // Bodies are streamed, so this only has to cover the TLS session itself
+  if (ESP.getFreeHeap() < 25000) {
+    xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+    debug_.last_ms = millis();
+    debug_.success = false;
+    debug_.code = -1;
+    debug_.error = "low_heap";
+    publishDebug();
+    xSemaphoreGive(settle_mtx_);
+    next_due_ = millis() + 2000;
+    waitWake(100);                                // heap has no event; poll
+    return false;
+  }
+  return true;
+}
+
+// ─────────────────────────────────────────────────────────────
+// Worker loops
+// ─────────────────────────────────────────────────────────────
+
+// SD stage. Owns every SD/repo access of the uploader: prepares batches and
+// applies acks. With cfg.pipeline it keeps one batch ready while another is
+// on the wire; without it, it waits for each ack before reading the next
+// batch, which reproduces the old serial loop for comparison.
+//
+// Order matters for per-scanner ordering: read the flush generation first,
+// then apply acks, then scan. A failed batch is pushed to done_q_ before the
+// generation is bumped, so a batch tagged with the new generation is always
+// prepared after the failed items were released.
+//
+// drainAcks() applies what is queued; if there is nothing it sleeps until a
+// hand-back or wake() notifies the stage (or `wait` elapses) and drains once more.
+void UploaderService::drainAcks(TickType_t wait){
+  Batch* b = nullptr;
+  bool any = false;
+  while (xQueueReceive(done_q_, &b, 0) == pdPASS) { ackBatch(*b); delete b; outstanding_--; any = true; }
+  if (any || !wait) return;
+  ulTaskNotifyTake(pdTRUE, wait);
+  while (xQueueReceive(done_q_, &b, 0) == pdPASS) { ackBatch(*b); delete b; outstanding_--; }
+}
+
+void UploaderService::sdStageLoop(){
+  static constexpr uint32_t kPrepareLeadMs = 300;   // start reading ahead of next_due_
+  uint32_t idle_due = 0;                            // next_due_ when we last found nothing
+
+  for(;;){
+    uint32_t gen = flush_gen_.load();
+    drainAcks(0);
+
+    // pipeline: the batches on the wire (window) + one ready; serial: one
+    // at a time. The repo cannot exclude unacked entries, so it never reads ahead.
+    bool off;
+    uint8_t depth;
+    {
+      auto uc = cfg();                       // released before blocking below
+      off = !enabled_ || uc->api.empty();
+      uint8_t par = window_;
+      if (exclusiveScanners() && uc->workers > par) par = uc->workers;
+      depth = (uc->pipeline && uc->use_sd_spool && sdfs_) ? par + 1 : 1;
+    }
+    if (off) { drainAcks(portMAX_DELAY); continue; }
+    if (outstanding_ >= depth) { drainAcks(portMAX_DELAY); continue; }   // an ack frees a slot
+
+    // read ahead only when the network stage will want a batch soon, and
+    // do not rescan for an idle spool until the network stage rescheduled
+    uint32_t due = next_due_;
+    int32_t until = (int32_t)(due - millis());
+    if (idle_due && due == idle_due) { drainAcks(portMAX_DELAY); continue; }   // until rescheduled
+    if (due && until > (int32_t)kPrepareLeadMs) {
+      drainAcks(pdMS_TO_TICKS(until - kPrepareLeadMs));
+      continue;
+    }
+
+    Batch* b = new Batch();
+    b->gen = gen;
+    bool got = prepareBatch(*b);
+    if (!got && b->blocked) {                // wait for a busy scanner's ack
+      delete b;
+      drainAcks(portMAX_DELAY);
+      continue;
+    }
+    idle_due = got ? 0 : due;                // an empty batch means "nothing pending"
+    outstanding_++;
+    xQueueSend(ready_q_, &b, portMAX_DELAY);
+  }
+}
+
+// Network stage: sends what the SD stage prepared and owns the cadence.
+// On windowed transports (MQTT) up to `window` batches await their ack at
+// once; they are settled strictly in submission order.
+void UploaderService::completeBatch(Batch* b){
+  auto uc = cfg();
+  xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+  settleBatch(*b);
+  // anything left pending must go out before newer records of its scanner
+  bool failed = false;
+  for (uint8_t v : b->verdict) if (v == Pending) { failed = true; break; }
+  const bool was = catchup_;
+  // windowed transports (MQTT) get no workers: each would open its own
+  // session under the same client id and the broker would keep dropping one
+  catchup_ = uc->workers > 1 && make_net_ && window_ == 1 && net_.window(uc->api) == 1 &&
+             debug_.draining && breaker_ == Breaker::Closed && enabled_;
+  if (catchup_ && !was)
+    for (auto* w : workers_) if (w) xTaskNotifyGive(w);
+  publishDebug();
+  xSemaphoreGive(settle_mtx_);
+  handBack(b);                             // ack applied asynchronously by the SD stage
+  if (failed) flush_gen_.fetch_add(1);
+  if (on_result_) on_result_();            // debug() already shows this batch
+}
+
+bool UploaderService::passThrough(Batch* b){
+  if (!b->count()) {                       // nothing pending (or only malformed records)
+    xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+    noteDrained(0);
+    if (debug_.code != -10) { debug_.last_ms = millis(); debug_.success = true; debug_.code = 204; debug_.error.clear(); }
+    next_due_ = millis() + nextDelayMs(b->remaining, b->oldest_age_s);
+    idle_ = !b->remaining;                 // sleep until something is ingested
+    catchup_ = false;
+    publishDebug();
+    xSemaphoreGive(settle_mtx_);
+    handBack(b);
+    return true;
+  }
+  if (b->gen != flush_gen_.load()) {       // prepared before a failure: would reorder
+    handBack(b);
+    return true;
+  }
+  return false;
+}
+
+void UploaderService::taskLoop(){
+  std::deque<Batch*> wire;                   // submitted, awaiting the transport ack
+
+  for(;;){
+    uint8_t w;
+    {
+      auto uc = cfg();
+      w = uc->pipeline ? net_.window(uc->api) : 1;
+      if (w > uc->window) w = uc->window;
+    }
+    if (w > kMaxWindow)  w = kMaxWindow;
+    if (w < 1)           w = 1;
+
+    // Block on the oldest ack only when nothing else may be sent meanwhile:
+    // window full, half-open probe pending, disabled, or the window is being
+    // resized (endpoint or cfg changed) and has to drain first
+    while (!wire.empty()) {
+      const bool full = wire.size() >= window_ || w != window_ ||
+                        breaker_ == Breaker::HalfOpen || !enabled_;
+      if (!reapBatch(*wire.front(), full ? 50 : 0)) break;
+      Batch* done = wire.front();
+      wire.pop_front();
+      completeBatch(done);
+    }
+    if (debug_.in_flight != wire.size()) {
+      xSemaphoreTake(settle_mtx_, portMAX_DELAY);
+      debug_.in_flight = wire.size();
+      publishDebug();
+      xSemaphoreGive(settle_mtx_);
+    }
+    if (!wire.empty() && (wire.size() >= window_ || w != window_ || breaker_ == Breaker::HalfOpen)) continue;
+    window_ = w;
+
+    if (!gateOpen()) continue;
+
+    Batch* b = nullptr;
+    if (xQueueReceive(ready_q_, &b, pdMS_TO_TICKS(50)) != pdPASS || !b) continue;
+    if (passThrough(b)) continue;
+    if (catchup_) spawnWorkers();
+
+    Serial.println("[UP] Starting upload cycle");
+    Serial.printf(" task=%p core=%d heap=%u\n",
+                  xTaskGetCurrentTaskHandle(), xPortGetCoreID(), (unsigned)ESP.getFreeHeap());
+    Serial.printf(" API: %s\n", cfg()->api.c_str());
+    Serial.printf(" Source: %s\n", b->repo ? "repo" : "spool");
+
+    sendBatch(*b, breaker_ == Breaker::HalfOpen, net_);
+    if (b->ticket) { wire.push_back(b); continue; }
+    if (window_ > 1) reapBatch(*b, 0);       // submit refused: settle as a failure now
+    completeBatch(b);
+  }
+}
+
+// ─────────────────────────────────────────────────────────────
+// Catch-up workers
+// ─────────────────────────────────────────────────────────────
+struct UploadWorkerArg { UploaderService* up; uint8_t idx; };
+
+static void uploader_worker_entry(void* arg){
+  auto* a = static_cast<UploadWorkerArg*>(arg);
+  a->up->workerLoop(a->idx);
+}
+
+// Started the first time a catch-up begins; idle (no connection, no TLS
+// buffers) whenever catch-up is off.
+void UploaderService::spawnWorkers(){
+  auto uc = cfg();
+  uint8_t n = uc->workers > kMaxWorkers ? kMaxWorkers : uc->workers;
+  for (uint8_t i = 1; i < n; ++i) {
+    if (workers_[i]) continue;
+    char name[12];
+    snprintf(name, sizeof(name), "upl_w%u", (unsigned)i);
+    auto* arg = new UploadWorkerArg{this, i};
+    if (xTaskCreatePinnedToCore(uploader_worker_entry, name, 6144, arg, 1, &workers_[i], 1) != pdPASS) {
+      workers_[i] = nullptr;
+      delete arg;
+      Serial.printf("[UP] WARN: catch-up worker %u not started (out of memory)\n", (unsigned)i);
+      return;
+    }
+  }
+}
+
+// Catch-up connection: takes prepared batches next to the network task while
+// a backlog drains. Cadence, breaker and gating stay with the network task;
+// a worker only runs while catch-up is on and the heap can hold one more TLS
+// session, so the budget, not the setting, decides how many are active.
+void UploaderService::workerLoop(uint8_t idx){
+  static constexpr uint32_t kConnHeap = 40000;   // one TLS session
+  static constexpr uint32_t kReserve  = 25000;   // same floor as gateOpen()
+  NetClient* net = nullptr;
+
+  for(;;){
+    if (!catchup_) { ulTaskNotifyTake(pdTRUE, portMAX_DELAY); continue; }   // woken when it starts
+    if (idx >= cfg()->workers || WiFi.status() != WL_CONNECTED) {
+      vTaskDelay(pdMS_TO_TICKS(200));
+      continue;
+    }
+    if (ESP.getFreeHeap() < kConnHeap + kReserve) { vTaskDelay(pdMS_TO_TICKS(100)); continue; }
+    if (!net && !(net = make_net_())) {            // out of memory: try again later
+      vTaskDelay(pdMS_TO_TICKS(1000));
+      continue;
+    }
+
+    Batch* b = nullptr;
+    if (xQueueReceive(ready_q_, &b, pdMS_TO_TICKS(100)) != pdPASS || !b) continue;
+    if (passThrough(b)) continue;
+
+    busy_workers_.fetch_add(1);
+    noteWorkers();
+    Serial.printf("[UP] Catch-up worker %u: scanner=%s items=%u\n",
+                  (unsigned)idx, b->scanner.c_str(), (unsigned)b->count());
+    sendBatch(*b, false, *net);
+    completeBatch(b);
+    busy_workers_.fetch_sub(1);
+    noteWorkers();
   }
 }
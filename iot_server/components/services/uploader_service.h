@@ -9,22 +9,83 @@
 #include "infra/log_repo.h"
 #include "infra/net_client.h"
 #include "infra/sd_fs.h"
+#include "infra/snapshot.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <set>
+#include <atomic>
+#include <functional>
+
+// Uplink body encoding. MsgPack sends {"data":[{"id":str,"rfid":bin,"ts":uint}]}:
+// the UID as raw bytes and the timestamp as epoch seconds (device local time).
+enum class UploadFormat : uint8_t { Json, MsgPack };
 
 struct UploadCfg {
   // REST endpoint
   std::string api;
+  UploadFormat format = UploadFormat::Json;
 
   // cadence + batching
   uint32_t    interval_ms = 15000;
-  size_t      batch_size  = 50;
+  size_t      batch_size  = 50;       // fixed size, or the starting point when adaptive
+
+  // adaptive batch size (AIMD): +batch_step after a full batch that came
+  // back under latency_target_ms, halved on timeouts/transport errors/413.
+  // The body byte budget caps it whatever the item count says.
+  bool        adaptive_batch    = true;
+  size_t      batch_min         = 5;
+  size_t      batch_max         = 500;
+  size_t      batch_step        = 10;
+  uint32_t    latency_target_ms = 3000;
+  size_t      body_budget       = 8192;   // bytes per request body
 
   // retry policy
   uint8_t     retry_count    = 0;     // additional attempts per batch
   uint32_t    retry_delay_ms = 2000;  // ms between retries
 
+  // idle -> new record: wait this long for more to coalesce before sending
+  uint32_t    ingest_coalesce_ms = 1000;
+
+  // adaptive drain: back-to-back batches while the backlog is large,
+  // early flush once the oldest pending record reaches the deadline
+  size_t      drain_threshold   = 0;      // pending items; 0 = 2 x batch_size
+  uint32_t    drain_gap_ms      = 250;    // pause between back-to-back batches
+  uint32_t    flush_deadline_ms = 60000;  // max age of a pending record; 0 = off
+
+  // failure handling: exponential backoff with jitter, circuit breaker
+  uint32_t    backoff_base_ms   = 2000;   // first backoff step
+  uint32_t    backoff_max_ms    = 300000; // backoff / open-breaker ceiling
+  uint16_t    breaker_threshold = 5;      // consecutive failures that open it
+
+  // two-stage pipeline: SD stage prepares batch N+1 and applies acks while
+  // the network stage has batch N on the wire. false = strictly serial
+  // (scan, send, ack, scan...), kept for throughput comparison.
+  bool        pipeline          = true;
+  // batches awaiting their transport ack at once, on transports that can
+  // (MQTT QoS1; NetClient::window). HTTPS is always one request at a time.
+  // MQTT delivery is at-least-once: a publish is only sent again once
+  // esp-mqtt's outbox has let go of it, but a PUBACK lost after the broker
+  // took the message still repeats it; set item_ids to let the receiver
+  // drop such duplicates.
+  uint8_t     window            = 4;
+  // catch-up: while draining a backlog, up to `workers` HTTPS connections
+  // upload in parallel, one scanner per connection (per-scanner order kept).
+  // Each extra connection needs ~40 KB of heap for TLS and only runs while
+  // that much is free. 1 = off; needs setNetFactory().
+  uint8_t     workers           = 1;
+
+  // per-item ack: every record carries an "id" (spool file name, or
+  // "<rfid>.<timestamp>" in repo mode). The server may answer
+  //   {"accepted":["id",...],"rejected":[{"id":"..","error":"..","retryable":false},...]}
+  // and only the accepted records are acknowledged; non-retryable rejects
+  // are moved to dead_dir. Without that body the batch is all-or-nothing.
+  // Off by default: it adds a field existing servers do not expect.
+  bool        item_ids          = false;
+  String      dead_dir          = "/spool_dead";
+
   // SPOOL mode (one file per log) — default ON
   bool        use_sd_spool   = true;
   String      spool_dir      = "/spool";
@@ -37,13 +98,25 @@ class UploaderService {
   SdFsImpl*    sdfs_ = nullptr; // nullable (repo-only mode if null)
 
   // task + state
-  TaskHandle_t task_ = nullptr;
+  TaskHandle_t task_ = nullptr;      // network stage (or the whole loop when serial)
+  TaskHandle_t sd_task_ = nullptr;   // SD stage (pipeline mode)
   volatile bool enabled_ = false;
-  uint16_t     consec_fail_ = 0;
-  static constexpr uint16_t kMaxConsecFail = 5;
+  volatile uint16_t consec_fail_ = 0;
   volatile uint32_t warmup_deadline_ms_ = 0;
 
 public:
+  // Circuit breaker: Closed -> (threshold failures, 429/503) -> Open ->
+  // (cool-down elapsed) -> HalfOpen: one single-item probe -> Closed | Open
+  enum class Breaker : uint8_t { Closed, Open, HalfOpen };
+  struct BreakerInfo {
+    Breaker  state        = Breaker::Closed;
+    uint16_t consec_fail  = 0;
+    uint32_t retry_in_ms  = 0;   // time left before the next attempt/probe
+    uint32_t trips        = 0;   // Closed/HalfOpen -> Open transitions since boot
+    int      last_code    = 0;
+  };
+  static const char* breakerName(Breaker b);
+
   struct UploadDebug {
     uint32_t     last_ms    = 0;
     int          code       = 0;
@@ -55,6 +128,27 @@ public:
     std::string  scanner;
     size_t       items      = 0;         // #records in last payload
     bool         array_body = true;      // kept for UI compatibility
+    size_t       backlog    = 0;         // pending items seen by the last scan
+    bool         draining   = false;     // sending back-to-back
+    float        drain_rate = 0.f;       // acknowledged items/s (5 s window)
+    uint32_t     next_in_ms = 0;         // delay chosen after the last cycle
+    bool         pipeline   = false;     // last batch was read ahead (cfg.pipeline)
+    uint32_t     sd_ms      = 0;         // scan+sort+build of the last batch
+    uint32_t     net_ms     = 0;         // POST incl. retries
+    uint32_t     ack_ms     = 0;         // delete/mark after the response
+    size_t       accepted   = 0;         // records acknowledged by the last response
+    size_t       rejected   = 0;         // records dead-lettered by the last response
+    bool         item_ack   = false;     // last response used the per-item contract
+    uint32_t     dead_total = 0;         // records dead-lettered since boot
+    const char*  format     = "json";    // encoding of the last body
+    uint32_t     bytes_per_item = 0;     // body bytes / records
+    uint32_t     encode_us  = 0;         // CPU time to encode the last body once
+    size_t       in_flight  = 0;         // batches awaiting a transport ack (MQTT)
+    uint8_t      workers    = 0;         // catch-up connections busy right now
+    size_t       batch_target = 0;       // current batch size (AIMD, before byte cap)
+    size_t       batch_limit  = 0;       // what the next batch may hold (byte cap applied)
+    uint32_t     rtt_ms       = 0;       // smoothed request latency the size is based on
+    NetTiming    timing;                 // resolve / connect+TLS / request of the last POST
   };
 
   // A single spooled record (filename encodes scanner+rfid; file body may hold ts)
@@ -65,27 +159,69 @@ public:
     String ts;       // first line of file (best-effort)
   };
 
+  // Per-scanner backlog as seen by the last spool scan
+  struct ScannerStat {
+    String   scanner;
+    size_t   pending        = 0;    // spool files for this scanner
+    String   oldest_ts;             // ISO ts of the oldest pending record
+    int32_t  oldest_age_s   = -1;   // -1 while the wall clock is not valid
+    uint32_t last_served_ms = 0;    // millis() of the last upload attempt
+    uint32_t batches        = 0;    // upload attempts since boot
+  };
+
+  // Wake-up reasons (task notification bits). The tasks block until one of
+  // these arrives or their next deadline passes; idle means no deadline.
+  enum Wake : uint32_t {
+    WakeIngest = 1u << 0,   // a record was spooled/appended
+    WakeWifi   = 1u << 1,   // STA got an IP
+    WakeConfig = 1u << 2,   // set()/cfg change
+    WakeStart  = 1u << 3,   // enabled (/api/upload/start)
+  };
+  void wake(uint32_t why);  // any task
+
   // ctors
   UploaderService(LogRepo& r, NetClient& n) : repo_(r), net_(n) {}
   UploaderService(LogRepo& r, NetClient& n, SdFsImpl& sdfs) : repo_(r), net_(n), sdfs_(&sdfs) {}
 
+  // Creates the extra connections used by catch-up workers (cfg.workers);
+  // may return nullptr (out of memory), the worker then retries later
+  void setNetFactory(NetClient* (*make)()) { make_net_ = make; }
+
+  // Called after every batch that reached the server, from the uploader's
+  // network/worker task; set during setup. Keep it short (post and return).
+  void onResult(std::function<void()> cb) { on_result_ = std::move(cb); }
+
   // config/state
-  void set(const UploadCfg& c) { cfg_ = c; }
-  const UploadCfg& cfg() const { return cfg_; }
+  void set(const UploadCfg& c) {
+    if (c.batch_size != cfg()->batch_size) aimd_items_ = 0;   // restart AIMD from the new size
+    cfg_.publish(c);
+    wake(WakeConfig);
+  }
+  // Pinned, immutable view; any task may hold it without locking
+  Snapshot<UploadCfg>::Ref cfg() const { return cfg_.read(); }
 
   bool isEnabled() const { return enabled_; }
-  void setEnabled(bool on) { enabled_ = on; }
+  void setEnabled(bool on) {
+    if (on) { resetBreaker(); lone_trust_ = true; }
+    enabled_ = on;
+    wake(on ? WakeStart : WakeConfig);
+  }
   void disable() { enabled_ = false; }
 
-  bool canRun() const { return !cfg_.api.empty() && cfg_.interval_ms >= 1000; }
+  bool canRun() const { auto c = cfg(); return !c->api.empty() && c->interval_ms >= 1000; }
 
   // lifecycle
   void ensureTask();
-  void taskLoop();
+  void taskLoop();      // network stage
+  void sdStageLoop();   // SD stage: scans, builds bodies, applies acks
+  void workerLoop(uint8_t idx);   // catch-up connection #idx (1..)
   void armWarmup(uint32_t ms);
 
   // debug
-  const UploadDebug& debug() const { return debug_; }
+  // Last published status; the uploader keeps writing its own working copy
+  Snapshot<UploadDebug>::Ref debug() const { return debug_snap_.read(); }
+  std::vector<ScannerStat> scannerStats() const;
+  BreakerInfo breaker() const;
 
 private:
   // spool helpers
@@ -93,11 +229,150 @@ private:
   static bool parseSpoolBase(const String& base, String& rfid, String& scanner);
   static bool readSmallTextFile(const String& path, String& out);
 
-  bool spoolListGrouped(size_t max_total,
-                        std::map<String, std::vector<SpoolItem>>& byScanner);
+  // Walks the whole spool dir; keeps at most per_scanner oldest items per scanner
+  bool spoolListGrouped(size_t per_scanner,
+                        std::map<String, std::vector<SpoolItem>>& byScanner,
+                        std::map<String, ScannerStat>& stats);
   bool spoolDeleteFiles(const std::vector<SpoolItem>& items);
+  // Moves rejected records to cfg.dead_dir, writing the reason into each file
+  bool spoolQuarantine(const std::vector<SpoolItem>& items, const std::vector<std::string>& why);
+
+  // Per-record outcome of a batch
+  enum Verdict : uint8_t { Pending = 0, Accepted, Dead };
+
+  // One upload unit travelling SD stage -> network stage -> SD stage
+  struct Batch {
+    bool                          repo = false;   // entries (repo) vs items (spool)
+    String                        scanner;
+    std::vector<SpoolItem>        items;
+    std::vector<String>           claimed;        // spool paths held in inflight_
+    std::vector<domain::LogEntry> entries;
+    size_t                        body_len = 0;   // exact streamed size
+    uint32_t                      gen = 0;        // flush generation at prepare time
+    size_t                        remaining = 0;  // backlog left once acked
+    int32_t                       oldest_age_s = -1;
+    uint32_t                      sd_ms = 0;
+    uint32_t                      ticket = 0;     // windowed transport handle (0 = sync)
+    uint32_t                      submit_ms = 0;
+    uint32_t                      ack_timeout_ms = 0; // NetClient::ackTimeoutMs, 0 = none
+    NetTiming                     timing;
+    // outcome (network stage)
+    bool                          sent = false;   // false: dropped before the wire
+    bool                          blocked = false; // pending data, but every such scanner is busy
+    bool                          success = false;
+    int                           code = 0;
+    uint32_t                      retry_after_ms = 0; // from the connection that sent it
+    std::string                   failMsg;
+    bool                          item_ack = false; // server answered with accepted/rejected
+    std::vector<uint8_t>          verdict;        // Verdict per record
+    std::vector<std::string>      reason;         // rejection message per record
+    size_t count() const { return repo ? entries.size() : items.size(); }
+  };
+
+  // Stages. prepare/ack touch SD and the repo (SD stage task only);
+  // send/settle touch the network and the breaker/cadence (network task only).
+  bool prepareBatch(Batch& b);              // false: nothing pending
+  class BatchBody;                          // streams a Batch as the request body
+  void sendBatch(Batch& b, bool probe, NetClient& net);   // sync post, or submit when windowed
+  bool reapBatch(Batch& b, uint32_t wait_ms); // windowed: false while unacked
+  void finishSend(Batch& b, const std::string& resp);
+  void completeBatch(Batch* b);              // settle + hand back to the SD stage
+  void handBack(Batch* b);                   // done_q_ + notify; settle_mtx_ not held
+  bool passThrough(Batch* b);                // empty/stale batch: handled, true
+  void spawnWorkers();
+  bool exclusiveScanners() const { return cfg()->workers > 1 && make_net_; }
+  void judgeBatch(Batch& b, const std::string& resp);   // fills verdict
+  bool loneDeadAllowed();                   // budget for dead-lettering a lone reject
+  static void itemId(const Batch& b, size_t i, char* out, size_t cap);
+  void settleBatch(const Batch& b);         // breaker + next_due_
+  void ackBatch(Batch& b);                  // delete / quarantine / markSent / markFailed
+  bool gateOpen();                          // enabled, Wi-Fi, due, breaker, heap
+  void drainAcks(TickType_t wait);          // SD stage; woken by handBack()/wake()
+  void publishDebug();                      // debug_ -> debug_snap_
+  void noteWorkers();
+  void waitWake(uint32_t ms);               // network task; kForever = no deadline
+  static constexpr uint32_t kForever = 0xFFFFFFFFu;
+
+  // Fair scheduler: every scanner with pending data is served once per round,
+  // oldest backlog first within the round. A scanner therefore waits at most
+  // (#scanners - 1) upload cycles, whatever the other backlogs look like.
+  // Scanners in `busy` (a batch outstanding on another connection) are skipped.
+  String pickScanner(const std::map<String, ScannerStat>& stats,
+                     const std::set<String>* busy = nullptr);
+
+  // Delay until the next cycle from what is still pending after this one
+  uint32_t nextDelayMs(size_t remaining, int32_t oldest_age_s);
+  // Batch size: AIMD from request latency/outcome, capped by the byte budget
+  size_t   batchLimit() const;
+  void     adaptBatch(const Batch& b);
+  void     noteDrained(size_t items);
+
+  // Breaker bookkeeping; onFailure returns the delay before the next attempt
+  void     resetBreaker();
+  void     onSuccess();
+  uint32_t onFailure(int code, uint32_t retry_after_ms);
+  uint32_t backoffMs() const;
+  bool     breakerBlocks();                     // true while Open
+  void   publishStats(std::map<String, ScannerStat>& stats);
 
 private:
-  UploadCfg   cfg_;
-  UploadDebug debug_;
+  Snapshot<UploadCfg>   cfg_;                 // set() publishes, tasks read
+  UploadDebug           debug_;               // working copy, under settle_mtx_
+  Snapshot<UploadDebug> debug_snap_;          // what debug() hands out
+
+  // scheduler state (uploader task only)
+  std::vector<String>                   served_round_;
+  std::map<String, ScannerStat>         served_;      // last_served_ms / batches
+  // last published per-scanner view (read by HTTP handlers)
+  std::vector<ScannerStat>              stats_;
+  // pipeline plumbing: ready_q_ holds the prepared batch (double buffer with
+  // the one on the wire), done_q_ carries finished batches back for acks
+  QueueHandle_t                         ready_q_ = nullptr;
+  QueueHandle_t                         done_q_  = nullptr;
+  std::atomic<uint32_t>                 flush_gen_{0};   // bumped on failure
+  std::set<String>                      inflight_;       // spool paths not yet acked (SD stage)
+  uint8_t                               outstanding_ = 0; // batches prepared, not acked (SD stage)
+  static constexpr uint8_t              kMaxWindow = 8;
+  static constexpr uint8_t              kMaxWorkers = 4;
+  std::set<String>                      busy_;           // scanners with a batch outstanding (SD stage)
+  NetClient*                          (*make_net_)() = nullptr;
+  std::function<void()>                 on_result_;       // onResult()
+  TaskHandle_t                          workers_[kMaxWorkers] = {};
+  volatile bool                         catchup_ = false; // workers may take batches
+  std::atomic<uint8_t>                  busy_workers_{0};
+  // serializes cadence/breaker/debug updates between the network task and workers
+  SemaphoreHandle_t                     settle_mtx_ = xSemaphoreCreateMutex();
+  volatile uint8_t                      window_ = 1;     // current transport window (network task)
+  // batch-size cap per scanner while hunting a record the server rejects
+  // without naming it (400/413/422 on a multi-record batch): halved on each
+  // such reply until the culprit is alone and can be dead-lettered (SD stage)
+  std::map<String, size_t>              suspect_;
+  // A lone record refused as bad data (no per-item body) is dead-lettered
+  // at most kLoneDeadCap times per kLoneDeadWindowMs. A server refusing
+  // everything would otherwise bisect and dead-letter the whole backlog one
+  // record at a time. Past the cap such rejects count as failures (breaker)
+  // and nothing more is dead-lettered until the server accepts a record
+  // again or the uploader is restarted (under settle_mtx_).
+  static constexpr uint8_t              kLoneDeadCap = 5;
+  static constexpr uint32_t             kLoneDeadWindowMs = 600000;
+  bool                                  lone_trust_ = true;
+  uint8_t                               lone_dead_ = 0;
+  uint32_t                              lone_t0_ms_ = 0;
+  volatile uint32_t                     next_due_ = 0;
+  bool                                  idle_ = false;   // nothing pending: sleep until woken
+  bool                                  prev_sta_up_ = false;
+
+  // circuit breaker
+  volatile Breaker                      breaker_       = Breaker::Closed;
+  volatile uint32_t                     open_until_ms_ = 0;
+  volatile uint32_t                     trips_         = 0;
+  volatile int                          last_code_     = 0;
+  // adaptive batch size (target written by the network side, read by the SD stage)
+  std::atomic<uint32_t>                 aimd_items_{0};  // 0 = start from cfg.batch_size
+  volatile uint32_t                     rtt_ewma_ms_ = 0;
+  volatile uint32_t                     bytes_per_item_ = 0;
+  // drain-rate window
+  uint32_t                              drain_t0_ms_ = 0;
+  size_t                                drain_items_ = 0;
+  SemaphoreHandle_t                     stats_mtx_ = xSemaphoreCreateMutex();
 };
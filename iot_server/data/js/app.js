@@ -49,13 +49,21 @@ $("modalNo")?.addEventListener("click", ()=> modal?.classList.add("hidden"));
   const startBtn = $("btnStartUpload");
   const statusText = $("uploadStatus");
   const stopBtn = $('btnStopUpload');
+  let lastUpload = '';
+  function applyUploadState(st){
+    const valid = !!st.valid;
+    if (startBtn) startBtn.disabled = !valid || !!st.enabled;
+    if (stopBtn) stopBtn.disabled = !st.enabled;
+    let onText = 'Uploading: ON';
+    if (st.breaker && st.breaker.state !== 'closed'){
+      onText = `Uploading: paused, server unavailable (retry in ${Math.ceil((st.breaker.retry_in_ms||0)/1000)}s)`;
+    }
+    if (lastUpload) onText += ` (last: ${lastUpload})`;
+    if (statusText) statusText.textContent = st.enabled ? onText : (valid ? 'Ready to start' : (st.reason||'Invalid config'));
+  }
   async function refreshUploadState(){
     try{
-      const st = await apiGet('/api/upload/status');
-      const valid = !!st.valid;
-      if (startBtn) startBtn.disabled = !valid || !!st.enabled;
-      if (stopBtn) stopBtn.disabled = !st.enabled;
-      if (statusText) statusText.textContent = st.enabled ? 'Uploading: ON' : (valid ? 'Ready to start' : (st.reason||'Invalid config'));
+      applyUploadState(await apiGet('/api/upload/status'));
     }catch{
       if (startBtn) startBtn.disabled = true;
       if (stopBtn) stopBtn.disabled = true;
@@ -74,31 +82,68 @@ $("modalNo")?.addEventListener("click", ()=> modal?.classList.add("hidden"));
       catch(e){ alert('Failed to stop: '+e); }
     });
   });
-  refreshUploadState();
-  setInterval(refreshUploadState, 5000);
-
   const body = $("logsBody");
-  body.innerHTML = `<tr><td colspan="3">Loading…</td></tr>`;
-
-  try {
-    const rows = await apiGet("/api/logs");
-    if (!Array.isArray(rows)) throw new Error("Bad data");
-    body.innerHTML = "";
-    for (const r of rows) {
-      const tr = document.createElement("tr");
-      const status = (r.sent ? 'Sent' : (r.message || 'Pending'));
-      tr.innerHTML = `
+  const kRecent = 20;                        // rows kept, as the device's kDashRecent
+  let fresh = false;                         // table still shows "No data"/"Loading"
+  function addRow(r, prepend){
+    const tr = document.createElement("tr");
+    const status = (r.sent ? 'Sent' : (r.message || 'Pending'));
+    tr.innerHTML = `
         <td>${r.scanner_id ?? ""}</td>
         <td>${r.rfid ?? ""}</td>
         <td>${r.timestamp ?? ""}</td>
         <td>${status}</td>
       `;
-      body.appendChild(tr);
-    }
-    if (!rows.length) {
-      body.innerHTML = `<tr><td colspan="3">No data</td></tr>`;
-    }
+    if (prepend) body.prepend(tr); else body.appendChild(tr);
+    while (body.rows.length > kRecent) body.lastElementChild.remove();
+  }
+
+  // One request for the whole page: status, last upload and recent scans
+  function showRows(rows){
+    body.innerHTML = "";
+    for (const r of rows) addRow(r, false);
+    fresh = !rows.length;
+    if (fresh) body.innerHTML = `<tr><td colspan="3">No data</td></tr>`;
+  }
+  async function refreshDashboard(){
+    const d = await apiGet('/api/dashboard');
+    const u = d.last || {};
+    if (u.last_ms) lastUpload = u.success ? `${u.accepted || u.items} sent` : `failed, code ${u.code}`;
+    applyUploadState(d.status || {});
+    if (!Array.isArray(d.recent)) throw new Error("Bad data");
+    showRows(d.recent);
+  }
+  async function pollDashboard(){
+    try{ await refreshDashboard(); }catch{ refreshUploadState(); }
+  }
+
+  // Live feed: scans, upload results and status are pushed by the device.
+  // The 5 s dashboard poll only runs while the feed is down.
+  let poll = setInterval(pollDashboard, 5000);
+  if (window.EventSource) {
+    const es = new EventSource('/api/events', { withCredentials: true });
+    es.addEventListener('open', ()=>{ if (poll) { clearInterval(poll); poll = null; } });
+    es.addEventListener('error', ()=>{ if (!poll) poll = setInterval(pollDashboard, 5000); });
+    es.addEventListener('status', ev=>{ try{ applyUploadState(JSON.parse(ev.data)); }catch{} });
+    es.addEventListener('upload', ev=>{
+      try{
+        const u = JSON.parse(ev.data);
+        lastUpload = u.success ? `${u.accepted ?? u.items} sent` : `failed, code ${u.code}`;
+      }catch{}
+    });
+    es.addEventListener('scan', ev=>{
+      try{
+        if (fresh) { body.innerHTML = ""; fresh = false; }
+        addRow(JSON.parse(ev.data), true);
+      }catch{}
+    });
+  }
+
+  body.innerHTML = `<tr><td colspan="3">Loading…</td></tr>`;
+  try {
+    await refreshDashboard();
   } catch {
     body.innerHTML = `<tr><td colspan="3">Failed to load logs</td></tr>`;
+    refreshUploadState();
   }
 })();
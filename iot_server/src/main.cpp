@@ -18,6 +18,7 @@
 #include "infra/net_client.h"
 #include "services/lora_rx_service.h"
 #include "services/uploader_service.h"
+#include "services/config_service.h"
 #include "api_http/http_api.h"
 
 // Factories
@@ -93,88 +94,16 @@ void setup(){
   }
   Serial.println(sd_ok ? "[SD] Mounted OK (CS=13)" : "[SD] Mount FAILED (CS=13)");
 
-  // ===== CONFIG LOAD (prefer SD, fallback LittleFS) =====
-  String apSsid="Device-Portal", apPass="12345678";
-  String staSsid="", staPass="", apiUrl="";
-  uint32_t uploadIntervalMs = 15000;
+  // ===== CONFIG LOAD (prefer SD, fallback LittleFS); RAM from here on =====
+  static ConfigService config(SDfs);
+  config.load();
+  String apSsid, apPass, staSsid, staPass, apiUrl;
+  uint32_t uploadIntervalMs;
   {
-    auto mergeAndNorm = [&](JsonDocument& src){
-      JsonDocument out;
-      out["wifi_ap_ssid"]      = src["wifi_ap_ssid"]      | "Device-Portal";
-      out["wifi_ap_password"]  = src["wifi_ap_password"]  | "12345678";
-      out["wifi_sta_ssid"]     = src["wifi_sta_ssid"]     | (src["ssid"]       | "");
-      out["wifi_sta_password"] = src["wifi_sta_password"] | (src["password"]   | "");
-      out["api_url"]           = src["api_url"]           | (src["apiUrl"]     | "");
-      out["upload_interval"]   = src["upload_interval"]   | (src["intervalMs"] | 15000);
-      return out;
-    };
-    const char* CFG_JSON = "/config.json";
-    bool loaded = false;
-    String raw;
-
-    if (SDfs.isMounted() && SDfs.readAll(CFG_JSON, raw)) {
-      JsonDocument d; auto err = deserializeJson(d, raw);
-      if (!err) {
-        JsonDocument n = mergeAndNorm(d);
-        apSsid           = String((const char*)(n["wifi_ap_ssid"]));
-        apPass           = String((const char*)(n["wifi_ap_password"]));
-        staSsid          = String((const char*)(n["wifi_sta_ssid"]));
-        staPass          = String((const char*)(n["wifi_sta_password"]));
-        apiUrl           = String((const char*)(n["api_url"]));
-        uploadIntervalMs = (uint32_t)n["upload_interval"];
-        String tmp; serializeJson(n, tmp); SDfs.writeAll(CFG_JSON, tmp);
-        loaded = true;
-        Serial.println("[CFG] Loaded from SD:/config.json");
-      } else {
-        Serial.printf("[CFG] SD:/config.json parse error: %s\n", err.c_str());
-      }
-    } else {
-      Serial.println("[CFG] SD not mounted or /config.json missing");
-    }
-
-    if (!loaded) {
-      File f = LittleFS.open("/config.json", "r");
-      if (f) {
-        String lraw; lraw.reserve(f.size()+16);
-        while (f.available()) lraw += (char)f.read();
-        f.close();
-        JsonDocument d; auto err = deserializeJson(d, lraw);
-        if (!err) {
-          JsonDocument n = mergeAndNorm(d);
-          apSsid           = String((const char*)(n["wifi_ap_ssid"]));
-          apPass           = String((const char*)(n["wifi_ap_password"]));
-          staSsid          = String((const char*)(n["wifi_sta_ssid"]));
-          staPass          = String((const char*)(n["wifi_sta_password"]));
-          apiUrl           = String((const char*)(n["api_url"]));
-          uploadIntervalMs = (uint32_t)n["upload_interval"];
-          loaded = true;
-          Serial.println("[CFG] Loaded from LittleFS:/config.json (fallback)");
-          if (SDfs.isMounted()) { String tmp; serializeJson(n, tmp); SDfs.writeAll(CFG_JSON, tmp); Serial.println("[CFG] Migrated LittleFS -> SD:/config.json"); }
-        } else {
-          Serial.printf("[CFG] LittleFS:/config.json parse error: %s\n", err.c_str());
-        }
-      } else {
-        Serial.println("[CFG] LittleFS:/config.json not found");
-      }
-    }
-
-    if (!loaded && SDfs.isMounted()) {
-      JsonDocument n;
-      n["auth_user"]        = "admin";
-      n["auth_password"]    = "admin";
-      n["wifi_ap_ssid"]      = apSsid.c_str();
-      n["wifi_ap_password"]  = apPass.c_str();
-      n["wifi_sta_ssid"]     = "";
-      n["wifi_sta_password"] = "";
-      n["api_url"]           = "";
-      n["upload_interval"]   = uploadIntervalMs;
-      String tmp; serializeJson(n, tmp); SDfs.writeAll(CFG_JSON, tmp);
-      Serial.println("[CFG] Created default SD:/config.json");
-    }
-
-    Serial.printf("[CFG] AP SSID='%s' PASS='%s'\n", apSsid.c_str(), apPass.c_str());
-    Serial.printf("[CFG] STA SSID='%s' PASS='%s'\n", staSsid.c_str(), staPass.c_str());
-    Serial.printf("[CFG] API URL='%s' INTERVAL=%u\n", apiUrl.c_str(), uploadIntervalMs);
+    auto c = config.get();
+    apSsid = c->wifi_ap_ssid;   apPass = c->wifi_ap_password;
+    staSsid = c->wifi_sta_ssid; staPass = c->wifi_sta_password;
+    apiUrl = c->api_url;        uploadIntervalMs = c->upload_interval;
   }
 
   // ===== Wi-Fi + DNS =====
@@ -191,9 +120,9 @@ void setup(){
 
   // ===== Core services =====
   LogRepo* repo = makeMemLogRepo(); repo->ensureReady();
-  NetClient* https = makeNetClientHttps();
+  NetClient* net = makeNetClient();      // https:// or mqtt(s):// by API URL
 
-  static UploaderService up(*repo, *https, SDfs);
+  static UploaderService up(*repo, *net, SDfs);
   {
     UploadCfg c;
     c.api = apiUrl.c_str();
@@ -202,11 +131,19 @@ void setup(){
     c.use_sd_spool = true;
     c.spool_dir = "/spool";
     up.set(c);
+    up.setNetFactory(makeNetClient);     // extra connections for catch-up (c.workers)
     up.setEnabled(true);
     up.armWarmup(1500);
     up.ensureTask();
   }
-  static HttpApi api(*repo, up); api.begin();
+  config.subscribe([](const AppConfig& c, uint32_t changed){
+    if (!(changed & ConfigService::ChangedApi)) return;
+    UploadCfg uc = *up.cfg();
+    uc.api = c.api_url.c_str();
+    uc.interval_ms = c.upload_interval;
+    up.set(uc);
+  });
+  static HttpApi api(*repo, up, config); api.begin();
   
   
   // ===== RTC and time =====
@@ -221,6 +158,10 @@ void setup(){
   // LoRa SS=27, RST=25, DIO0=26 — keep CS pins unique and HIGH by default
   LoRaPort* lora = makeLoRaPortArduino(LORA_CS, 25, 26, &SPI, 433E6);
   static LoraRxService rx(*lora, *repo, *rtc);
+  rx.onIngest([](const domain::LogEntry& e){
+    up.wake(UploaderService::WakeIngest);
+    HttpApi::publishScan(e);                 // live feed, no SD read-back
+  });
   xTaskCreate([](void*){ rx.begin(); rx.taskLoop(); }, "lora_rx", 4096, nullptr, 1, nullptr);
 
   // ===== Sync NTP -> RTC later =====
@@ -0,0 +1,10 @@
+#pragma once
+// Host stand-in for the FreeRTOS types the tested headers use (env:native)
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
@@ -0,0 +1,11 @@
+#pragma once
+// Host stand-in: FreeRTOS mutexes over std::mutex (env:native)
+#include <mutex>
+#include "FreeRTOS.h"
+
+typedef std::mutex* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex(){ return new std::mutex(); }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t){ m->lock(); return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t m){ m->unlock(); return pdTRUE; }
+inline void vSemaphoreDelete(SemaphoreHandle_t m){ delete m; }
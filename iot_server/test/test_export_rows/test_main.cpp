@@ -0,0 +1,94 @@
+// /api/export row rendering (host: pio test -e native), plus the CPU side
+// of a 100k-row export: name split, range filter and row formatting.
+// SD directory reads and the AP link are not part of it.
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "api_http/export_rows.h"
+
+using namespace export_rows;
+
+void test_split_spool_name(){
+  char rfid[kRfidMax + 1], ts14[15], sc[kScannerMax + 1];
+  TEST_ASSERT_TRUE(splitSpoolName("/spool/LOG.04A1B2C3.20250101120000.gate-1", rfid, ts14, sc));
+  TEST_ASSERT_EQUAL_STRING("04A1B2C3", rfid);
+  TEST_ASSERT_EQUAL_STRING("20250101120000", ts14);
+  TEST_ASSERT_EQUAL_STRING("gate-1", sc);
+  TEST_ASSERT_TRUE(splitSpoolName("LOG.AB.20250101120000.s_2.3", rfid, ts14, sc));   // collision suffix
+  TEST_ASSERT_EQUAL_STRING("s_2", sc);
+
+  TEST_ASSERT_FALSE(splitSpoolName("LOG.AB.2025010112000.s", rfid, ts14, sc));      // 13 digits
+  TEST_ASSERT_FALSE(splitSpoolName("LOG.AB.2025010112000x.s", rfid, ts14, sc));
+  TEST_ASSERT_FALSE(splitSpoolName("LOG..20250101120000.s", rfid, ts14, sc));
+  TEST_ASSERT_FALSE(splitSpoolName("LOG.A-B.20250101120000.s", rfid, ts14, sc));
+  TEST_ASSERT_FALSE(splitSpoolName("LOG.AB.20250101120000.", rfid, ts14, sc));
+  TEST_ASSERT_FALSE(splitSpoolName("LOG.AB.20250101120000.s\"x", rfid, ts14, sc));  // no JSON escaping needed
+  TEST_ASSERT_FALSE(splitSpoolName("DATA.AB.20250101120000.s", rfid, ts14, sc));
+  std::string longRfid = "LOG." + std::string(kRfidMax + 1, 'A') + ".20250101120000.s";
+  TEST_ASSERT_FALSE(splitSpoolName(longRfid.c_str(), rfid, ts14, sc));
+}
+
+void test_rows(){
+  char row[kRowMax];
+  TEST_ASSERT_EQUAL(strlen("scanner_id,rfid,timestamp,state\n"), csvHeader(row, sizeof(row)));
+  size_t n = csvRow(row, sizeof(row), "gate-1", "04A1", "20250101120000", "pending");
+  TEST_ASSERT_EQUAL_STRING("gate-1,04A1,2025-01-01 12:00:00,pending\n", row);
+  TEST_ASSERT_EQUAL(strlen(row), n);
+  n = ndjsonRow(row, sizeof(row), "gate-1", "04A1", "20250101120000", "dead");
+  TEST_ASSERT_EQUAL_STRING("{\"scanner_id\":\"gate-1\",\"rfid\":\"04A1\","
+                           "\"timestamp\":\"2025-01-01 12:00:00\",\"state\":\"dead\"}\n", row);
+  TEST_ASSERT_EQUAL(strlen(row), n);
+  TEST_ASSERT_EQUAL(0, csvRow(row, 8, "gate-1", "04A1", "20250101120000", "pending"));
+  TEST_ASSERT_EQUAL(19, isoTimestamp(row, sizeof(row), "20250131235959"));
+  TEST_ASSERT_EQUAL_STRING("2025-01-31 23:59:59", row);
+  TEST_ASSERT_EQUAL(0, isoTimestamp(row, 19, "20250131235959"));
+}
+
+// Fields at their limits still fit kRowMax
+void test_longest_row_fits(){
+  char row[kRowMax];
+  std::string rfid(kRfidMax, 'A'), sc(kScannerMax, 's');
+  TEST_ASSERT_TRUE(ndjsonRow(row, sizeof(row), sc.c_str(), rfid.c_str(), "20250101120000", "pending") > 0);
+  TEST_ASSERT_TRUE(csvRow(row, sizeof(row), sc.c_str(), rfid.c_str(), "20250101120000", "pending") > 0);
+}
+
+static void exportRun(bool csv){
+  static const size_t kRows = 100000;
+  static char names[kRows][64];
+  for (size_t i = 0; i < kRows; ++i)
+    snprintf(names[i], sizeof(names[i]), "LOG.04A1%08X.202501%02u%02u%02u%02u.gate-%u",
+             (unsigned)i, (unsigned)(1 + i % 28), (unsigned)(i / 3600 % 24),
+             (unsigned)(i / 60 % 60), (unsigned)(i % 60), (unsigned)(i % 4));
+  const char from[] = "20250101000000", to[] = "20250131235959";
+
+  char rfid[kRfidMax + 1], ts14[15], sc[kScannerMax + 1], row[kRowMax];
+  size_t rows = 0, bytes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  if (csv) bytes += csvHeader(row, sizeof(row));
+  for (size_t i = 0; i < kRows; ++i) {
+    if (!splitSpoolName(names[i], rfid, ts14, sc)) continue;
+    if (strcmp(ts14, from) < 0 || strcmp(ts14, to) > 0) continue;
+    bytes += csv ? csvRow(row, sizeof(row), sc, rfid, ts14, "pending")
+                 : ndjsonRow(row, sizeof(row), sc, rfid, ts14, "pending");
+    rows++;
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  printf("  %s: %u rows, %u bytes in %.1f ms (%.1f MB/s, host CPU)\n", csv ? "csv" : "ndjson",
+         (unsigned)rows, (unsigned)bytes, s * 1e3, bytes / s / 1e6);
+  TEST_ASSERT_EQUAL(kRows, rows);
+}
+
+void test_export_100k_rows_ndjson(){ exportRun(false); }
+void test_export_100k_rows_csv(){ exportRun(true); }
+
+int main(int, char**){
+  UNITY_BEGIN();
+  RUN_TEST(test_split_spool_name);
+  RUN_TEST(test_rows);
+  RUN_TEST(test_longest_row_fits);
+  RUN_TEST(test_export_100k_rows_ndjson);
+  RUN_TEST(test_export_100k_rows_csv);
+  return UNITY_END();
+}
@@ -0,0 +1,182 @@
+// Round trip of the upload body encodings (host: pio test -e native).
+// The MessagePack side is checked with an independent minimal decoder;
+// tools/upload_sink.py decodes the same bodies with the msgpack package.
+#include <unity.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "services/upload_codec.h"
+
+using namespace upload_codec;
+
+// --- minimal MessagePack reader: just the types the encoder emits ---
+struct Reader {
+  const uint8_t* p;
+  size_t         n;
+  size_t         k = 0;
+  bool           ok = true;
+
+  uint8_t  u8()  { if (k >= n) { ok = false; return 0; } return p[k++]; }
+  uint32_t be(int bytes) { uint32_t v = 0; while (bytes--) v = (v << 8) | u8(); return v; }
+
+  size_t map() {
+    uint8_t t = u8();
+    if ((t & 0xf0) == 0x80) return t & 0x0f;
+    ok = false; return 0;
+  }
+  size_t array() {
+    uint8_t t = u8();
+    if ((t & 0xf0) == 0x90) return t & 0x0f;
+    if (t == 0xdc) return be(2);
+    if (t == 0xdd) return be(4);
+    ok = false; return 0;
+  }
+  std::string str() {
+    uint8_t t = u8();
+    size_t len;
+    if ((t & 0xe0) == 0xa0) len = t & 0x1f;
+    else if (t == 0xd9)     len = u8();
+    else { ok = false; return std::string(); }
+    if (k + len > n) { ok = false; return std::string(); }
+    std::string s((const char*)p + k, len);
+    k += len;
+    return s;
+  }
+  // rfid: bin8 or str; returned as upper-case hex for bin
+  std::string rfid() {
+    if (k < n && p[k] == 0xc4) {
+      k++;
+      size_t len = u8();
+      std::string hex;
+      char b[3];
+      for (size_t i = 0; i < len; ++i) { snprintf(b, sizeof(b), "%02X", u8()); hex += b; }
+      return hex;
+    }
+    return str();
+  }
+  // ts: uint32 or nil (-1)
+  int64_t ts() {
+    uint8_t t = u8();
+    if (t == 0xc0) return -1;
+    if (t == 0xce) return be(4);
+    ok = false; return 0;
+  }
+};
+
+struct Decoded { std::string id, rfid; int64_t ts; bool has_id; };
+
+static std::vector<Decoded> decode(const std::vector<uint8_t>& body){
+  Reader r{body.data(), body.size()};
+  std::vector<Decoded> out;
+  TEST_ASSERT_EQUAL(1, r.map());
+  TEST_ASSERT_EQUAL_STRING("data", r.str().c_str());
+  size_t n = r.array();
+  for (size_t i = 0; i < n && r.ok; ++i) {
+    Decoded d{std::string(), std::string(), 0, false};
+    size_t fields = r.map();
+    for (size_t f = 0; f < fields && r.ok; ++f) {
+      std::string key = r.str();
+      if      (key == "id")   { d.id = r.str(); d.has_id = true; }
+      else if (key == "rfid") d.rfid = r.rfid();
+      else if (key == "ts")   d.ts = r.ts();
+      else                    r.ok = false;
+    }
+    out.push_back(d);
+  }
+  TEST_ASSERT_TRUE(r.ok);
+  TEST_ASSERT_EQUAL(body.size(), r.k);       // nothing trailing
+  return out;
+}
+
+static std::vector<uint8_t> encodeMp(const std::vector<Record>& recs){
+  std::vector<uint8_t> body;
+  uint8_t piece[kPieceMax + 1];
+  size_t len = mpHead(piece, recs.size());
+  body.insert(body.end(), piece, piece + len);
+  for (const auto& r : recs) {
+    len = mpRecord(piece, r);
+    TEST_ASSERT_TRUE(len <= kPieceMax);
+    body.insert(body.end(), piece, piece + len);
+  }
+  return body;
+}
+
+void test_msgpack_round_trip(){
+  std::vector<Record> recs = {
+    { "LOG.04A1B2C3.20250101120000.S1", "04A1B2C3", "2025-01-01 12:00:00", 1735732800 },
+    { "LOG.XYZ.20250101120001.S1",      "XYZ",      "",                    -1 },          // not hex, no ts
+    { "odd",                            "ABC",      "",                    0x100000000LL }, // odd length, ts out of range
+    { "zero",                           "00",       "1970-01-01 00:00:00", 0 },
+  };
+  auto out = decode(encodeMp(recs));
+  TEST_ASSERT_EQUAL(recs.size(), out.size());
+  TEST_ASSERT_EQUAL_STRING("LOG.04A1B2C3.20250101120000.S1", out[0].id.c_str());
+  TEST_ASSERT_EQUAL_STRING("04A1B2C3", out[0].rfid.c_str());
+  TEST_ASSERT_EQUAL_INT64(1735732800, out[0].ts);
+  TEST_ASSERT_EQUAL_STRING("XYZ", out[1].rfid.c_str());
+  TEST_ASSERT_EQUAL_INT64(-1, out[1].ts);          // nil
+  TEST_ASSERT_EQUAL_STRING("ABC", out[2].rfid.c_str());
+  TEST_ASSERT_EQUAL_INT64(-1, out[2].ts);          // nil
+  TEST_ASSERT_EQUAL_STRING("00", out[3].rfid.c_str());
+  TEST_ASSERT_EQUAL_INT64(0, out[3].ts);
+}
+
+void test_msgpack_without_ids(){
+  std::vector<Record> recs = { { nullptr, "DEADBEEF", "", 1700000000 } };
+  auto out = decode(encodeMp(recs));
+  TEST_ASSERT_EQUAL(1, out.size());
+  TEST_ASSERT_FALSE(out[0].has_id);
+  TEST_ASSERT_EQUAL_STRING("DEADBEEF", out[0].rfid.c_str());
+  TEST_ASSERT_EQUAL_INT64(1700000000, out[0].ts);
+}
+
+void test_msgpack_array_header_sizes(){
+  const size_t counts[] = { 0, 15, 16, 65535, 65536 };
+  for (size_t c : counts) {
+    uint8_t piece[16];
+    size_t len = mpHead(piece, c);
+    Reader r{piece, len};
+    TEST_ASSERT_EQUAL(1, r.map());
+    TEST_ASSERT_EQUAL_STRING("data", r.str().c_str());
+    TEST_ASSERT_EQUAL(c, r.array());
+    TEST_ASSERT_TRUE(r.ok);
+    TEST_ASSERT_EQUAL(len, r.k);
+  }
+}
+
+void test_json_body(){
+  char piece[kPieceMax + 1];
+  std::string body;
+  body += std::string(piece, jsonHead(piece, sizeof(piece)));
+  Record a{ "id1", "04A1", "2025-01-01 12:00:00", -1 };
+  Record b{ nullptr, "04A2", "", -1 };
+  body += std::string(piece, jsonRecord(piece, sizeof(piece), 0, a));
+  body += std::string(piece, jsonRecord(piece, sizeof(piece), 1, b));
+  body += std::string(piece, jsonTail(piece, sizeof(piece)));
+  TEST_ASSERT_EQUAL_STRING(
+    "{\"data\":[{\"id\":\"id1\",\"rfid\":\"04A1\",\"timestamp\":\"2025-01-01 12:00:00\"},"
+    "{\"rfid\":\"04A2\",\"timestamp\":\"\"}]}", body.c_str());
+}
+
+// Fields at their limits still fit one piece in both encodings
+void test_pieces_fit_at_field_limits(){
+  std::string id(kMaxId, 'i'), rfid(kMaxRfid, 'A'), ts(kMaxTs, '9');
+  Record r{ id.c_str(), rfid.c_str(), ts.c_str(), 0xFFFFFFFFLL };
+  char piece[512];
+  TEST_ASSERT_TRUE(jsonRecord(piece, sizeof(piece), 1, r) <= kPieceMax);
+  TEST_ASSERT_TRUE(mpRecord((uint8_t*)piece, r) <= kPieceMax);
+  std::string notHex(kMaxRfid, 'Z');
+  r.rfid = notHex.c_str();
+  TEST_ASSERT_TRUE(mpRecord((uint8_t*)piece, r) <= kPieceMax);
+}
+
+int main(int, char**){
+  UNITY_BEGIN();
+  RUN_TEST(test_msgpack_round_trip);
+  RUN_TEST(test_msgpack_without_ids);
+  RUN_TEST(test_msgpack_array_header_sizes);
+  RUN_TEST(test_json_body);
+  RUN_TEST(test_pieces_fit_at_field_limits);
+  return UNITY_END();
+}
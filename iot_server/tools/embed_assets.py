@@ -0,0 +1,153 @@
+# PlatformIO pre-script: bakes the web UI into the firmware.
+#
+# Every build: data/**/*.{html,css,js} are minified, gzipped (level 9,
+# mtime 0) and written as const byte arrays to
+# $BUILD_DIR/generated/ui_assets.h, together with a strong ETag per file.
+# The arrays live in flash (rodata) and HttpApi streams them from there, so
+# the UI needs neither littlefs.bin nor heap. The header is only rewritten
+# when its content changes, so unchanged assets do not trigger a rebuild.
+#
+# Pages reference their CSS/JS by plain path; each such src/href gets
+# "?v=<ETag of that asset>" here, and HttpApi serves ?v= URLs as immutable.
+# An edited asset thus gets a new URL by itself, never a stale cached copy.
+#
+# buildfs/uploadfs: the LittleFS image is staged without those files; they
+# would only take space there.
+Import("env")
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+
+FS_TARGETS = {"buildfs", "uploadfs", "uploadfsota"}
+MIME = {
+    ".html": "text/html; charset=utf-8",
+    ".css":  "text/css; charset=utf-8",
+    ".js":   "application/javascript",
+}
+
+
+# Conservative minifiers: whitespace and comments only, line structure of
+# JS kept so automatic semicolon insertion behaves exactly as before
+def minify(ext, text):
+    if ext == ".css":
+        text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+        text = re.sub(r"\s+", " ", text)
+        text = re.sub(r"\s*([{};:,>])\s*", r"\1", text)
+        return text.strip()
+    if ext == ".html":
+        text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+        return "\n".join(l.strip() for l in text.splitlines() if l.strip())
+    lines = []
+    for l in text.splitlines():
+        l = l.strip()
+        if l and not l.startswith("//"):
+            lines.append(l)
+    return "\n".join(lines)
+
+
+def etag_of(data):
+    return hashlib.sha1(data).hexdigest()[:16]
+
+
+# src="/x.js" and href="/x.css?v=..." of a known asset -> "?v=<its ETag>"
+def version_refs(text, tags):
+    def ref(m):
+        path = m.group(2)
+        if path not in tags:
+            return m.group(0)
+        return '%s="%s?v=%s"' % (m.group(1), path, tags[path])
+    return re.sub(r'\b(src|href)="(/[^"?#]*)(?:\?[^"]*)?"', ref, text)
+
+
+# Pages last: their references carry the ETags of everything else
+def collect(src):
+    files = []
+    for root, _, names in os.walk(src):
+        for name in sorted(names):
+            ext = os.path.splitext(name)[1]
+            if ext not in MIME:
+                continue
+            path = os.path.join(root, name)
+            url = "/" + os.path.relpath(path, src).replace(os.sep, "/")
+            with open(path, "r", encoding="utf-8") as f:
+                files.append((ext == ".html", url, ext, f.read()))
+    assets, tags = [], {}
+    for page, url, ext, raw in sorted(files):
+        text = version_refs(raw, tags) if page else raw
+        data = gzip.compress(minify(ext, text).encode("utf-8"), compresslevel=9, mtime=0)
+        etag = etag_of(data)
+        if not page:                            # pages themselves stay revalidated
+            tags[url] = etag
+        assets.append((url, MIME[ext], data, len(raw.encode("utf-8")), etag))
+    return sorted(assets)
+
+
+def header(assets):
+    out = ["// Generated by tools/embed_assets.py from data/ -- do not edit",
+           "#pragma once", "#include <stddef.h>", "#include <stdint.h>", "",
+           "struct UiAsset {",
+           "  const char*    path;      // URL path == path under data/",
+           "  const char*    mime;",
+           "  const uint8_t* data;      // gzip, in flash",
+           "  size_t         len;",
+           "  const char*    etag;",
+           "};", ""]
+    total_raw = total = 0
+    for i, (url, mime, data, raw, _) in enumerate(assets):
+        out.append("// %s: %u -> %u bytes" % (url, raw, len(data)))
+        out.append("static const uint8_t kUiAsset%d[] = {" % i)
+        for j in range(0, len(data), 20):
+            out.append("  " + ",".join("0x%02x" % b for b in data[j:j + 20]) + ",")
+        out.append("};")
+        total_raw += raw
+        total += len(data)
+    out.append("")
+    out.append("static const UiAsset kUiAssets[] = {")
+    for i, (url, mime, _, _, etag) in enumerate(assets):
+        out.append('  { "%s", "%s", kUiAsset%d, sizeof(kUiAsset%d), "\\"%s\\"" },' % (url, mime, i, i, etag))
+    if not assets:
+        out.append('  { "", "", nullptr, 0, "" },')
+    out.append("};")
+    out.append("static const size_t kUiAssetCount = %d;" % len(assets))
+    out.append("")
+    return "\n".join(out), total_raw, total
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path, "r", encoding="utf-8") as f:
+            if f.read() == text:
+                return False
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    return True
+
+
+def stage_fs(src, dst):
+    shutil.rmtree(dst, ignore_errors=True)
+    os.makedirs(dst, exist_ok=True)
+    for root, _, files in os.walk(src):
+        for name in files:
+            if os.path.splitext(name)[1] in MIME:
+                continue
+            out = os.path.join(dst, os.path.relpath(root, src))
+            os.makedirs(out, exist_ok=True)
+            shutil.copy2(os.path.join(root, name), out)
+
+
+data_dir = env.subst("$PROJECT_DATA_DIR")
+gen_dir = os.path.join(env.subst("$BUILD_DIR"), "generated")
+assets = collect(data_dir) if os.path.isdir(data_dir) else []
+text, raw, packed = header(assets)
+if write_if_changed(os.path.join(gen_dir, "ui_assets.h"), text):
+    print("embed_assets: %d files, %d -> %d bytes" % (len(assets), raw, packed))
+env.Append(CPPPATH=[gen_dir])
+
+if FS_TARGETS & set(COMMAND_LINE_TARGETS):
+    fs_dir = os.path.join(env.subst("$BUILD_DIR"), "data_fs")
+    stage_fs(data_dir, fs_dir)
+    env.Replace(PROJECT_DATA_DIR=fs_dir)
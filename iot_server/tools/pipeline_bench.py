@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# Serial vs pipelined upload throughput, emulated on the host.
+#
+# Mirrors the uploader's two stages (UploadCfg::pipeline) against a running
+# tools/upload_sink.py: the SD stage "prepares" a batch (--sd-ms, standing
+# in for the directory scan, sort and file reads the device reports as
+# sd_ms in /api/upload/status) and applies the previous batch's ack
+# (--ack-ms, the deletes), the network stage POSTs a real JSON body of
+# --batch records over one keep-alive connection. Serial runs prepare,
+# send, ack one after the other; pipelined keeps one batch prepared while
+# another is on the wire, with acks handed back to the SD stage.
+#
+#   python3 tools/upload_sink.py --port 8080 --delay-ms 150 --idle-s 60
+#   python3 tools/pipeline_bench.py --port 8080 --sd-ms 80 --ack-ms 20
+#
+# This measures the overlap the design buys for the stage costs given, not
+# the device: for that, drain the same backlog with pipeline=false and
+# pipeline=true and compare the sink's drain lines.
+import argparse
+import http.client
+import json
+import queue
+import sys
+import threading
+import time
+
+
+def body(seq, n):
+    recs = [{"id": "%08d.log" % (seq * n + i), "rfid": "04A1B2C3%04X" % i,
+             "timestamp": "2025-01-01 12:00:%02d" % (i % 60)} for i in range(n)]
+    return json.dumps({"data": recs}).encode()
+
+
+class Net:
+    def __init__(self, host, port):
+        self.conn = http.client.HTTPConnection(host, port)
+
+    def post(self, data):
+        self.conn.request("POST", "/up", data, {"Content-Type": "application/json",
+                                               "X-API-Key": "BENCH"})
+        r = self.conn.getresponse()
+        r.read()
+        if r.status != 200:
+            raise RuntimeError("sink answered %d" % r.status)
+
+
+def prepare(seq, a):
+    time.sleep(a.sd_ms / 1000.0)
+    return body(seq, a.batch)
+
+
+def serial(a, net):
+    for seq in range(a.batches):
+        data = prepare(seq, a)
+        net.post(data)
+        time.sleep(a.ack_ms / 1000.0)
+
+
+def pipelined(a, net):
+    ready = queue.Queue(maxsize=1)             # prepared, waiting for the wire
+    done = queue.Queue()                       # sent, waiting for the ack to be applied
+
+    def sd_stage():
+        for seq in range(a.batches):
+            while True:                        # acks first, as the device does
+                try:
+                    done.get_nowait()
+                except queue.Empty:
+                    break
+                time.sleep(a.ack_ms / 1000.0)
+            ready.put(prepare(seq, a))
+        ready.put(None)
+
+    t = threading.Thread(target=sd_stage)
+    t.start()
+    while True:
+        data = ready.get()
+        if data is None:
+            break
+        net.post(data)
+        done.put(True)
+    t.join()
+    time.sleep(a.ack_ms / 1000.0)              # the last ack
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--batches", type=int, default=40)
+    ap.add_argument("--batch", type=int, default=50, help="records per batch")
+    ap.add_argument("--sd-ms", type=float, default=80.0, help="SD stage cost per batch")
+    ap.add_argument("--ack-ms", type=float, default=20.0, help="applying one ack")
+    a = ap.parse_args()
+    recs = a.batches * a.batch
+    for name, run in (("serial", serial), ("pipeline", pipelined)):
+        net = Net(a.host, a.port)
+        t0 = time.monotonic()
+        run(a, net)
+        secs = time.monotonic() - t0
+        print("%-8s %d records in %.2f s: %.0f rec/s" % (name, recs, secs, recs / secs), flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
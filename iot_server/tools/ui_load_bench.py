@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+# Page-load bytes and time for the web UI, before and after the asset
+# handler, emulated on the host.
+#
+# Serves data/ two ways from a local server:
+#   before  every file as it is on disk, Cache-Control: no-store,
+#           Connection: close (the old hand-written routes)
+#   after   what tools/embed_assets.py bakes in: minified, gzip -9, strong
+#           ETag, pages referencing ?v=<ETag> URLs, 304 on If-None-Match,
+#           max-age for ?v= URLs, keep-alive
+# and loads each page like a browser: the page, then its ?v= CSS/JS, once
+# with an empty cache and once more as a repeat visit. Bytes are counted
+# on the wire (status line, headers and body). Time comes from the
+# emulated link: --rtt-ms per request and per new connection, and the
+# response bytes at --kbps; loopback time itself is negligible.
+#
+#   python3 tools/ui_load_bench.py --rtt-ms 20 --kbps 4000
+import argparse
+import ast
+import gzip
+import http.client
+import os
+import re
+import sys
+import threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DATA = os.path.join(HERE, "..", "data")
+ROUTES = {"/": "/index.html", "/configuration": "/configuration.html", "/login": "/login.html"}
+
+
+def load_embed():
+    # collect() from embed_assets.py, without running its PlatformIO part
+    src = open(os.path.join(HERE, "embed_assets.py"), encoding="utf-8").read()
+    tree = ast.parse(src)
+    keep = [n for n in tree.body if isinstance(n, (ast.Import, ast.ImportFrom, ast.FunctionDef))
+            or (isinstance(n, ast.Assign) and all(isinstance(t, ast.Name) and t.id.isupper()
+                                                  for t in n.targets))]
+    ns = {}
+    exec(compile(ast.Module(body=keep, type_ignores=[]), "embed_assets.py", "exec"), ns)
+    return ns["collect"]
+
+
+def assets():
+    out = {}
+    for url, mime, packed, _, etag in load_embed()(DATA):
+        raw = open(os.path.join(DATA, url[1:]), "rb").read()
+        out[url] = (mime, raw, packed, '"%s"' % etag)
+    return out
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        path, _, query = self.path.partition("?")
+        a = self.server.assets.get(ROUTES.get(path, path))
+        if not a:
+            self.send_error(404)
+            return
+        mime, raw, packed, etag = a
+        if self.server.mode == "before":
+            self.send_response(200)
+            self.send_header("Content-Type", mime)
+            self.send_header("Content-Length", str(len(raw)))
+            self.send_header("Cache-Control", "no-store")
+            self.send_header("Connection", "close")
+            self.end_headers()
+            self.wfile.write(raw)
+            self.close_connection = True
+            return
+        cc = "public, max-age=31536000, immutable" if query.startswith("v=") else "no-cache"
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Cache-Control", cc)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header("Content-Type", mime)
+        self.send_header("Content-Encoding", "gzip")
+        self.send_header("Content-Length", str(len(packed)))
+        self.send_header("ETag", etag)
+        self.send_header("Cache-Control", cc)
+        self.end_headers()
+        self.wfile.write(packed)
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+class Browser:
+    """Sequential loader with a cache, counting wire bytes and link time"""
+
+    def __init__(self, port, rtt_s, bytes_per_s):
+        self.port, self.rtt_s, self.bps = port, rtt_s, bytes_per_s
+        self.conn = None
+        self.cache = {}                        # url -> (etag, immutable, body)
+
+    def get(self, url, stats):
+        c = self.cache.get(url)
+        if c and c[1]:
+            return c[2]                        # max-age: no request at all
+        if self.conn is None:
+            self.conn = http.client.HTTPConnection("127.0.0.1", self.port)
+            stats["connections"] += 1
+            stats["link_s"] += self.rtt_s      # TCP handshake
+        hdrs = {"Accept-Encoding": "gzip"}
+        if c:
+            hdrs["If-None-Match"] = c[0]
+        self.conn.request("GET", url, headers=hdrs)
+        r = self.conn.getresponse()
+        body = r.read()
+        head = len("HTTP/1.1 %d %s\r\n" % (r.status, r.reason)) + \
+            sum(len("%s: %s\r\n" % kv) for kv in r.getheaders()) + 2
+        stats["requests"] += 1
+        stats["bytes"] += head + len(body)
+        stats["link_s"] += self.rtt_s + (head + len(body)) / self.bps
+        if r.getheader("Connection", "").lower() == "close":
+            self.conn.close()
+            self.conn = None
+        if r.status == 304:
+            return c[2]
+        if r.getheader("Content-Encoding") == "gzip":
+            body = gzip.decompress(body)
+        etag = r.getheader("ETag")
+        if etag:
+            self.cache[url] = (etag, "immutable" in r.getheader("Cache-Control", ""), body)
+        return body
+
+    def page(self, url):
+        stats = dict(requests=0, connections=0, bytes=0, link_s=0.0)
+        html = self.get(url, stats).decode("utf-8")
+        for ref in re.findall(r'(?:src|href)="(/(?:css|js)/[^"]+)"', html):
+            self.get(ref, stats)
+        return stats
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--rtt-ms", type=float, default=20.0, help="round trip over the AP")
+    ap.add_argument("--kbps", type=float, default=4000.0, help="link rate, kbit/s")
+    a = ap.parse_args()
+    srv = ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+    srv.assets = assets()
+    threading.Thread(target=srv.serve_forever, daemon=True).start()
+    port = srv.server_address[1]
+    print("link: %.0f ms RTT, %.0f kbit/s" % (a.rtt_ms, a.kbps))
+    for mode in ("before", "after"):
+        srv.mode = mode
+        for page in ("/", "/configuration", "/login"):
+            b = Browser(port, a.rtt_ms / 1000.0, a.kbps * 125.0)
+            for visit in ("first", "repeat"):
+                s = b.page(page)
+                print("%-6s %-14s %-6s %2d req %d conn %6d bytes %5.0f ms"
+                      % (mode, page, visit, s["requests"], s["connections"], s["bytes"],
+                         s["link_s"] * 1000), flush=True)
+    srv.shutdown()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
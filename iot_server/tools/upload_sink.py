@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+# Stand-in for the upload server, for checking what the uploader sends.
+#
+# Accepts POSTs on any path, decodes the body by Content-Type
+# (application/json or application/msgpack), checks its shape against
+# components/services/upload_codec.h and prints one line per batch. When
+# the records carry ids it answers with the per-item contract
+# ({"accepted":[...],"rejected":[...]}), otherwise with a plain 200.
+#
+#   python3 tools/upload_sink.py --port 8080
+#   python3 tools/upload_sink.py --reject 'DEAD'   # reject rfids matching
+#
+# Catch-up benchmark (drain time against cfg.workers): --delay-ms holds
+# every response that long, standing in for the round trip to the cloud.
+# Requests are served concurrently, one thread per connection. Once no
+# request has arrived for --idle-s, the sink prints a drain summary:
+# records, batches, elapsed time from the first to the last request, peak
+# concurrent requests, and per-scanner ordering violations (a record older
+# than one already received for the same X-API-Key).
+#
+#   python3 tools/upload_sink.py --delay-ms 300
+#   then on the device: stop the uploader, let a backlog build, set
+#   workers=N, start it, and read the drain line.
+#
+# Point the uploader's URL at http://<host>:8080/... . MsgPack bodies need
+# the msgpack package (pip install msgpack).
+import argparse
+import json
+import re
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+try:
+    import msgpack
+except ImportError:
+    msgpack = None
+
+
+class BadBody(Exception):
+    pass
+
+
+def decode(ctype, body):
+    if ctype.startswith("application/msgpack"):
+        if msgpack is None:
+            raise BadBody("msgpack body but the msgpack package is missing")
+        doc = msgpack.unpackb(body, raw=False)
+    else:
+        doc = json.loads(body)
+    if not isinstance(doc, dict) or set(doc) != {"data"} or not isinstance(doc["data"], list):
+        raise BadBody('expected {"data":[...]}')
+    out = []
+    for i, r in enumerate(doc["data"]):
+        if not isinstance(r, dict):
+            raise BadBody("record %d is not a map" % i)
+        rec = {"id": r.get("id")}
+        if rec["id"] is not None and not isinstance(rec["id"], str):
+            raise BadBody("record %d: id is not a string" % i)
+        rfid = r.get("rfid")
+        if isinstance(rfid, bytes):
+            rfid = rfid.hex().upper()          # MsgPack sends hex UIDs as bin
+        if not isinstance(rfid, str):
+            raise BadBody("record %d: rfid missing" % i)
+        rec["rfid"] = rfid
+        if "ts" in r:                          # MsgPack: uint32 seconds or nil
+            if r["ts"] is not None and not (isinstance(r["ts"], int) and 0 <= r["ts"] <= 0xFFFFFFFF):
+                raise BadBody("record %d: ts is not uint32/nil" % i)
+            rec["ts"] = r["ts"]
+        elif "timestamp" in r:                 # JSON: "YYYY-MM-DD HH:MM:SS" or ""
+            rec["ts"] = r["timestamp"]
+        else:
+            raise BadBody("record %d: no timestamp" % i)
+        extra = set(r) - {"id", "rfid", "ts", "timestamp"}
+        if extra:
+            raise BadBody("record %d: unexpected fields %s" % (i, sorted(extra)))
+        out.append(rec)
+    return out
+
+
+class Drain:
+    """Counts one drain: the requests up to --idle-s of silence"""
+
+    def __init__(self, idle_s):
+        self.idle_s = idle_s
+        self.lock = threading.Lock()
+        self.reset()
+        threading.Thread(target=self.watch, daemon=True).start()
+
+    def reset(self):
+        self.first = self.last = None
+        self.records = self.batches = self.active = self.peak = self.reordered = 0
+        self.newest = {}                       # scanner -> newest ts seen
+
+    def begin(self):
+        with self.lock:
+            now = time.monotonic()
+            if self.first is None:
+                self.first = now
+            self.last = now
+            self.active += 1
+            self.peak = max(self.peak, self.active)
+
+    def end(self, scanner=None, recs=()):
+        with self.lock:
+            self.active -= 1
+            self.last = time.monotonic()
+            if scanner is None:
+                return
+            self.batches += 1
+            self.records += len(recs)
+            for r in recs:
+                ts = r["ts"]
+                if ts is None or ts == "":
+                    continue
+                prev = self.newest.get(scanner)
+                if prev is not None and type(prev) is type(ts) and ts < prev:
+                    self.reordered += 1
+                else:
+                    self.newest[scanner] = ts
+
+    def watch(self):
+        while True:
+            time.sleep(0.5)
+            with self.lock:
+                if self.first is None or self.active or time.monotonic() - self.last < self.idle_s:
+                    continue
+                secs = max(self.last - self.first, 1e-6)
+                print("drain: %d records in %d batches, %.2f s (%.0f rec/s), peak %d concurrent, "
+                      "%d out of order" % (self.records, self.batches, secs, self.records / secs,
+                                           self.peak, self.reordered), flush=True)
+                self.reset()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def read_body(self):
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            body = b""
+            while True:
+                size = int(self.rfile.readline().split(b";")[0], 16)
+                if size == 0:
+                    self.rfile.readline()
+                    return body
+                body += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def reply(self, code, doc):
+        data = json.dumps(doc).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_POST(self):
+        body = self.read_body()
+        ctype = self.headers.get("Content-Type", "")
+        drain = self.server.drain
+        drain.begin()
+        try:
+            recs = decode(ctype, body)
+        except (BadBody, ValueError) as e:
+            print("%s %s: %d bytes, BAD: %s" % (self.command, self.path, len(body), e), flush=True)
+            drain.end()
+            self.reply(400, {"error": str(e)})
+            return
+        if self.server.delay_s:
+            time.sleep(self.server.delay_s)
+        drain.end(self.headers.get("X-API-Key", ""), recs)
+        reject = self.server.reject
+        rejected = [r for r in recs if reject and reject.search(r["rfid"])]
+        nil_ts = sum(1 for r in recs if r["ts"] is None or r["ts"] == "")
+        print("%s %s: %s %d bytes, %d records (%d without time), %d rejected"
+              % (self.command, self.path, ctype or "?", len(body), len(recs), nil_ts, len(rejected)),
+              flush=True)
+        if self.server.verbose:
+            for r in recs:
+                print("   ", r, flush=True)
+        if all(r["id"] for r in recs):
+            self.reply(200, {
+                "accepted": [r["id"] for r in recs if r not in rejected],
+                "rejected": [{"id": r["id"], "error": "rfid refused by sink"} for r in rejected],
+            })
+        elif rejected:
+            self.reply(422, {"error": "rfid refused by sink"})
+        else:
+            self.reply(200, {"ok": True})
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--reject", help="regex; records whose rfid matches are rejected")
+    ap.add_argument("-v", "--verbose", action="store_true", help="print every record")
+    ap.add_argument("--delay-ms", type=int, default=0, help="hold every response this long")
+    ap.add_argument("--idle-s", type=float, default=5.0, help="silence that ends a drain")
+    a = ap.parse_args()
+    srv = ThreadingHTTPServer(("", a.port), Handler)
+    srv.reject = re.compile(a.reject) if a.reject else None
+    srv.verbose = a.verbose
+    srv.delay_s = a.delay_ms / 1000.0
+    srv.drain = Drain(a.idle_s)
+    print("upload sink on :%d (msgpack %s, delay %d ms)"
+          % (a.port, "ok" if msgpack else "unavailable", a.delay_ms), flush=True)
+    try:
+        srv.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())